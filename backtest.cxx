@@ -0,0 +1,112 @@
+#include "backtest.h"
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+
+void forecastScorer::add(const std::string& stage, const double p, const bool passed) {
+  const double o = (passed ? 1. : 0.);
+  const double pClip = std::min(std::max(p, kMinProbability), 1. - kMinProbability);
+  if (m_stages.empty()) m_stages.push_back("All");
+  if (m_scores.count(stage) == 0) m_stages.push_back(stage);
+  for (const std::string& key : {std::string("All"), stage}) {
+    forecastScore& s = m_scores[key];
+    ++s.n;
+    s.sumBrier += (p - o) * (p - o);
+    s.sumLogLoss -= (o * std::log(pClip)) + ((1. - o) * std::log(1. - pClip));
+  }
+  reliabilityBin& bin = m_reliability.at(std::min((int)(p * kReliabilityBins), kReliabilityBins - 1));
+  ++bin.n;
+  bin.sumP += p;
+  bin.passed += passed;
+}
+
+bool forecastScorer::write(const std::string& fname, const int year, const float chiG_Test, const float chiGD_Test) const {
+  std::ofstream out(fname);
+  if (!out) {
+    std::cout << "Error. Cannot write forecast scores to " << fname << std::endl;
+    return false;
+  }
+  out << std::setprecision(6);
+  for (const std::string& stage : m_stages) {
+    const forecastScore& s = m_scores.at(stage);
+    out << "score " << year << " " << stage << " " << s.n << " " << s.brier() << " " << s.logLoss() << std::endl;
+  }
+  for (int b = 0; b < kReliabilityBins; ++b) {
+    const reliabilityBin& bin = m_reliability.at(b);
+    if (bin.n == 0) continue;
+    out << "reliability " << year << " " << b << " " << bin.n << " " << bin.sumP / bin.n << " " << bin.passed / (double)bin.n << std::endl;
+  }
+  out << "chi2 " << year << " " << chiG_Test << " " << chiGD_Test << std::endl;
+  return true;
+}
+
+namespace {
+  // "year stage" -> (Brier, log-loss)
+  std::map<std::string, std::pair<double, double>> readScores(const std::string& fname) {
+    std::map<std::string, std::pair<double, double>> scores;
+    std::ifstream in(fname);
+    std::string line;
+    while (getline(in, line)) {
+      std::istringstream ss(line);
+      std::string type, year, stage;
+      int n;
+      double brier, logLoss;
+      if (ss >> type >> year >> stage >> n >> brier >> logLoss && type == "score") scores[year + " " + stage] = std::make_pair(brier, logLoss);
+    }
+    return scores;
+  }
+}
+
+void printBacktest(const std::string& fname) {
+  std::ifstream in(fname);
+  std::string line, type, year;
+  std::cout << std::fixed << std::setprecision(4);
+  while (getline(in, line)) {
+    std::istringstream ss(line);
+    ss >> type >> year;
+    if (type == "score") {
+      std::string stage;
+      int n;
+      double brier, logLoss;
+      ss >> stage >> n >> brier >> logLoss;
+      if (stage == "All") std::cout << std::endl << year << "    Stage     N   Brier  LogLoss" << std::endl;
+      std::cout << "        " << std::setw(5) << std::left << stage << std::right << std::setw(6) << n << std::setw(8) << brier << std::setw(9) << logLoss << std::endl;
+    } else if (type == "reliability") {
+      int bin, n;
+      double p, observed;
+      ss >> bin >> n >> p >> observed;
+      std::cout << "        P in [" << bin / (double)kReliabilityBins << "," << (bin + 1) / (double)kReliabilityBins << "): N=" << std::setw(4) << n
+        << " forecast " << p << " observed " << observed << std::endl;
+    } else if (type == "chi2") {
+      float chiG, chiGD;
+      ss >> chiG >> chiGD;
+      if (chiG >= 0) std::cout << "        chi2/DoF against " << year << " results: G=" << chiG << " GD=" << chiGD << std::endl;
+    }
+  }
+  std::cout << std::defaultfloat << std::endl;
+}
+
+bool compareToBaseline(const std::string& fname, const std::string& baseline) {
+  const std::map<std::string, std::pair<double, double>> now = readScores(fname);
+  const std::map<std::string, std::pair<double, double>> before = readScores(baseline);
+  if (before.empty()) {
+    std::cout << "Error. No scores in baseline " << baseline << std::endl;
+    return false;
+  }
+  bool degraded = false;
+  std::cout << std::fixed << std::setprecision(4) << "Comparison to " << baseline << " (Brier, LogLoss)" << std::endl;
+  for (const auto& [key, score] : now) {
+    std::map<std::string, std::pair<double, double>>::const_iterator it = before.find(key);
+    if (it == before.end()) continue;
+    const bool worse = (score.first > it->second.first + kBacktestTolerance || score.second > it->second.second + kBacktestTolerance);
+    degraded |= worse;
+    std::cout << "  " << std::setw(10) << std::left << key << std::right << " " << it->second.first << " -> " << score.first
+      << "  " << it->second.second << " -> " << score.second << (worse ? "  DEGRADED" : "") << std::endl;
+  }
+  std::cout << std::defaultfloat << (degraded ? "Forecasting quality DEGRADED" : "Forecasting quality OK") << std::endl;
+  return !degraded;
+}
@@ -0,0 +1,49 @@
+#ifndef WCMC_BACKTEST_H
+#define WCMC_BACKTEST_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Proper scoring of the stage-progression forecasts against what actually happened.
+// Every (team, stage) pair is one binary forecast: the MC probability of passing the stage, and whether the team did.
+
+const int kReliabilityBins = 10;
+const double kMinProbability = 1e-6; // Clip for the log-loss, an impossible outcome that happens is not infinitely bad
+const double kBacktestTolerance = 2e-3; // Allowed increase in Brier score or log-loss before a change counts as a degradation
+
+struct forecastScore {
+  forecastScore() : n(0), sumBrier(0), sumLogLoss(0) {}
+  double brier() const { return n ? sumBrier / n : 0.; }
+  double logLoss() const { return n ? sumLogLoss / n : 0.; }
+  int n;
+  double sumBrier;
+  double sumLogLoss;
+};
+
+struct reliabilityBin {
+  reliabilityBin() : n(0), sumP(0), passed(0) {}
+  int n;
+  double sumP;
+  int passed;
+};
+
+class forecastScorer {
+public:
+  forecastScorer() : m_reliability(kReliabilityBins) {}
+
+  void add(const std::string& stage, const double p, const bool passed);
+  bool empty() const { return m_scores.empty(); }
+  bool write(const std::string& fname, const int year, const float chiG_Test, const float chiGD_Test) const;
+
+private:
+  std::vector<std::string> m_stages; // "All" first, then in the order they were scored
+  std::map<std::string, forecastScore> m_scores;
+  std::vector<reliabilityBin> m_reliability;
+};
+
+// Summary files hold the lines written by forecastScorer::write for one or more years
+void printBacktest(const std::string& fname);
+bool compareToBaseline(const std::string& fname, const std::string& baseline); // False if forecasting got worse
+
+#endif // WCMC_BACKTEST_H
@@ -0,0 +1,109 @@
+#ifndef WCMC_BETSTRATEGY_H
+#define WCMC_BETSTRATEGY_H
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <vector>
+
+// Staking strategies for the exact score bets, backtested on the real outcomes and Monte-Carlo'd under the model.
+// Flat and value bets stake one unit, Kelly stakes a fraction of the bankroll.
+
+enum stakeRule_t {kFlatStake, kValueStake, kKellyStake};
+
+const double kStartBankroll = 64.; // One unit per game, as toyBets
+
+struct pricedBet {
+  std::string fixture; // As in the odds file
+  double odd;
+  bool won;
+  int game; // Line of the odds file, and of the results file
+  double p; // Model probability of the score backed
+  int goalsA, goalsB; // Score backed
+};
+
+struct stakeRule {
+  stakeRule(const stakeRule_t r, const double x) : rule(r), param(x) {}
+  std::string name() const { return (rule == kFlatStake ? "flat" : rule == kValueStake ? "value" : "kelly"); }
+  // Stake is fixed + fraction * bankroll
+  void stake(const pricedBet& bet, double& fixed, double& fraction) const {
+    const double edge = bet.p * bet.odd - 1.;
+    fixed = fraction = 0.;
+    if (rule == kFlatStake || (rule == kValueStake && edge >= param)) fixed = 1.;
+    else if (rule == kKellyStake && edge > 0) fraction = std::min(param * edge / (bet.odd - 1.), 1.);
+  }
+  stakeRule_t rule;
+  double param; // Value: minimum edge p * odd - 1. Kelly: fraction of the full Kelly stake
+};
+
+struct bankrollSummary {
+  int bets = 0; // Placed in the real tournament
+  double staked = 0;
+  double realised = 0; // Final bankroll on the real outcomes
+  double mean = 0, median = 0, p05 = 0, p95 = 0, pLoss = 0; // Final bankroll under the model
+};
+
+// Final bankrolls for rounds of the tournament, outcome of bet g in round r is u[g * rounds + r] < bet.p.
+// Rounds are independent lanes so the inner loop vectorises.
+inline bankrollSummary playStrategy(const stakeRule& rule, const std::vector<pricedBet>& bets, const std::vector<double>& u, const long rounds,
+  std::vector<double>& bank) {
+  bankrollSummary s;
+  double real = kStartBankroll;
+  bank.assign(rounds, kStartBankroll);
+  for (size_t g = 0; g < bets.size(); ++g) {
+    const pricedBet& bet = bets[g];
+    double fixed, fraction;
+    rule.stake(bet, fixed, fraction);
+    if (fixed == 0 && fraction == 0) continue;
+    const double stake = fixed + fraction * real;
+    ++s.bets;
+    s.staked += stake;
+    real += (bet.won ? stake * (bet.odd - 1.) : -stake);
+    const double* ug = u.data() + g * rounds;
+    const double p = bet.p, win = bet.odd - 1.;
+    for (long r = 0; r < rounds; ++r) {
+      const double st = fixed + fraction * bank[r];
+      bank[r] += (ug[r] < p ? st * win : -st);
+    }
+  }
+  s.realised = real;
+  if (rounds == 0) return s;
+  long losses = 0;
+  for (long r = 0; r < rounds; ++r) {
+    s.mean += bank[r];
+    losses += (bank[r] < kStartBankroll);
+  }
+  s.mean /= rounds;
+  s.pLoss = losses / (double) rounds;
+  std::nth_element(bank.begin(), bank.begin() + rounds / 20, bank.end());
+  s.p05 = bank[rounds / 20];
+  std::nth_element(bank.begin(), bank.begin() + rounds / 2, bank.end());
+  s.median = bank[rounds / 2];
+  std::nth_element(bank.begin(), bank.begin() + (rounds * 19) / 20, bank.end());
+  s.p95 = bank[(rounds * 19) / 20];
+  return s;
+}
+
+// The odds file and the simulation spell some teams differently, e.g. "South Korea" and "Korea Rp."
+// Same team if the names share a word of at least four letters, or one name starts with the other.
+inline bool sameTeam(const std::string& a, const std::string& b) {
+  auto words = [](const std::string& name) {
+    std::vector<std::string> w(1);
+    for (const char c : name) {
+      if (isalpha((unsigned char) c)) w.back() += tolower((unsigned char) c);
+      else if (!w.back().empty()) w.emplace_back();
+    }
+    return w;
+  };
+  const std::vector<std::string> wa = words(a), wb = words(b);
+  std::string ja, jb;
+  for (const std::string& w : wa) ja += w;
+  for (const std::string& w : wb) jb += w;
+  if (std::min(ja.size(), jb.size()) >= 4 && (ja.compare(0, jb.size(), jb) == 0 || jb.compare(0, ja.size(), ja) == 0)) return true;
+  for (const std::string& x : wa) {
+    if (x.size() >= 4 && std::count(wb.begin(), wb.end(), x)) return true;
+  }
+  return false;
+}
+
+#endif // WCMC_BETSTRATEGY_H
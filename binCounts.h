@@ -0,0 +1,115 @@
+#ifndef WCMC_BINCOUNTS_H
+#define WCMC_BINCOUNTS_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Exact 64-bit histogram counts for the simulation. Float bins stop counting at 2^24 entries and double ones at 2^53,
+// so runs accumulate here and copy into double histograms for output.
+// Cells are numbered as TH1 and TH2: 0 is the underflow and nx + 1 the overflow of each row, rows are y bins.
+// Weights are whole numbers, e.g. goals. The sum of squared weights is kept once a weight other than 1 is seen, as TH1::Fill.
+
+class binCounts {
+public:
+  binCounts() : m_nx(0), m_ny(0), m_xLow(0), m_xHigh(0), m_yLow(0), m_yHigh(0), m_entries(0) {}
+  binCounts(const int nx, const double xLow, const double xHigh, const int ny = 0, const double yLow = 0, const double yHigh = 0)
+    : m_nx(nx), m_ny(ny), m_xLow(xLow), m_xHigh(xHigh), m_yLow(yLow), m_yHigh(yHigh), m_counts((nx + 2) * (ny > 0 ? ny + 2 : 1)), m_entries(0) {}
+
+  void fill(const double x, const uint64_t w = 1) { add(bin(x, m_nx, m_xLow, m_xHigh), w); }
+  void fill2(const double x, const double y) { add(bin(y, m_ny, m_yLow, m_yHigh) * (m_nx + 2) + bin(x, m_nx, m_xLow, m_xHigh), 1); }
+
+  void reset() {
+    m_counts.assign(m_counts.size(), 0);
+    m_sumw2.clear();
+    m_entries = 0;
+  }
+
+  // Another count of the same binning, e.g. from another thread
+  void add(const binCounts& other) {
+    if (!other.m_sumw2.empty() && m_sumw2.empty()) m_sumw2 = m_counts;
+    for (int i = 0; i < cells(); ++i) {
+      m_counts[i] += other.m_counts[i];
+      if (!m_sumw2.empty()) m_sumw2[i] += (other.m_sumw2.empty() ? other.m_counts[i] : other.m_sumw2[i]);
+    }
+    m_entries += other.m_entries;
+  }
+
+  // Counts read back as doubles, e.g. from a partial results file. False if the binning differs
+  bool add(const std::vector<double>& counts, const std::vector<double>& sumw2, const double entries) {
+    if ((int) counts.size() != cells() || (!sumw2.empty() && sumw2.size() != counts.size())) return false;
+    if (!sumw2.empty() && m_sumw2.empty()) m_sumw2 = m_counts;
+    for (int i = 0; i < cells(); ++i) {
+      m_counts[i] += std::llround(counts[i]);
+      if (!m_sumw2.empty()) m_sumw2[i] += std::llround(sumw2.empty() ? counts[i] : sumw2[i]);
+    }
+    m_entries += std::llround(entries);
+    return true;
+  }
+
+  int cells() const { return m_counts.size(); }
+  int nx() const { return m_nx; }
+  int ny() const { return m_ny; }
+  int cell(const int x, const int y = 0) const { return y * (m_nx + 2) + x; } // Bin numbers as TH1::GetBin
+  uint64_t count(const int cell) const { return m_counts[cell]; }
+  uint64_t entries() const { return m_entries; }
+  bool weighted() const { return !m_sumw2.empty(); }
+  uint64_t sumw2(const int cell) const { return (m_sumw2.empty() ? m_counts[cell] : m_sumw2[cell]); }
+  uint64_t total() const { // Every cell, under and overflows included
+    uint64_t sum = 0;
+    for (const uint64_t n : m_counts) sum += n;
+    return sum;
+  }
+  int maximumCell() const { // In-range cell with the largest count, the first on a tie, as TH1::GetMaximumBin
+    int best = cell(1, (m_ny > 0 ? 1 : 0));
+    for (int y = (m_ny > 0 ? 1 : 0); y <= m_ny; ++y) {
+      for (int x = 1; x <= m_nx; ++x) if (m_counts[cell(x, y)] > m_counts[best]) best = cell(x, y);
+    }
+    return best;
+  }
+  // Entries of unit weight with the same relative error, as the NORM option of TH1::Chi2Test
+  double effectiveCount(const int cell) const {
+    if (m_sumw2.empty()) return m_counts[cell];
+    return (m_sumw2[cell] > 0 ? std::floor((double) m_counts[cell] * m_counts[cell] / m_sumw2[cell] + 0.5) : 0);
+  }
+  uint64_t integral() const { // In-range bins, as TH1::Integral
+    uint64_t sum = 0;
+    for (int y = (m_ny > 0 ? 1 : 0); y <= m_ny; ++y) {
+      for (int x = 1; x <= m_nx; ++x) sum += m_counts[y * (m_nx + 2) + x];
+    }
+    return sum;
+  }
+
+  // Contents, errors and entries of a histogram with the same binning, e.g. a TH1D or TH2D
+  template <typename H>
+  void copyTo(H* h) const {
+    for (int i = 0; i < cells(); ++i) h->SetBinContent(i, (double) m_counts[i]);
+    if (!m_sumw2.empty() || h->GetSumw2N() > 0) { // Errors left over in h are replaced too
+      if (h->GetSumw2N() == 0) h->Sumw2();
+      for (int i = 0; i < cells(); ++i) (*h->GetSumw2())[i] = (double) (m_sumw2.empty() ? m_counts[i] : m_sumw2[i]);
+    }
+    h->SetEntries((double) m_entries);
+  }
+
+private:
+  static int bin(const double v, const int n, const double low, const double high) {
+    if (v < low) return 0;
+    if (v >= high) return n + 1;
+    return 1 + (int)(n * (v - low) / (high - low));
+  }
+
+  void add(const int cell, const uint64_t w) {
+    if (w != 1 && m_sumw2.empty()) m_sumw2 = m_counts; // Unit weights so far
+    m_counts[cell] += w;
+    if (!m_sumw2.empty()) m_sumw2[cell] += w * w;
+    ++m_entries;
+  }
+
+  int m_nx, m_ny;
+  double m_xLow, m_xHigh, m_yLow, m_yHigh;
+  std::vector<uint64_t> m_counts;
+  std::vector<uint64_t> m_sumw2;
+  uint64_t m_entries;
+};
+
+#endif // WCMC_BINCOUNTS_H
@@ -0,0 +1,241 @@
+#include "historicMatches.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char kHistoricMagic[8] = {'W', 'C', 'M', 'C', 'H', 'I', 'S', 'T'};
+static const uint64_t kHistoricMaxName = 1 << 10; // Sanity limit on names read back from the cache
+static const size_t kHistoricMatchesPerThread = 1 << 14;
+
+struct historicCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t nNames;
+  uint64_t nMatches;
+  uint64_t csvSize;
+  int64_t csvTime;
+};
+
+namespace {
+  uint32_t dateOf(std::string_view s) {
+    if (s.size() != 10 || s[4] != '-' || s[7] != '-') return 0;
+    uint32_t date = 0;
+    for (const size_t i : {0, 1, 2, 3, 5, 6, 8, 9}) {
+      if (s[i] < '0' || s[i] > '9') return 0;
+      date = date * 10 + (s[i] - '0');
+    }
+    return date;
+  }
+
+  // Goals, or -1 for anything else such as NA
+  int goalsOf(std::string_view s) {
+    if (s.empty() || s.size() > 3) return -1;
+    int goals = 0;
+    for (const char c : s) {
+      if (c < '0' || c > '9') return -1;
+      goals = goals * 10 + (c - '0');
+    }
+    return std::min(goals, 255);
+  }
+}
+
+uint32_t historicMatches::parseDate(const std::string& date) {
+  return dateOf(date);
+}
+
+bool historicMatches::load(const std::string& fname) {
+  struct stat st;
+  if (stat(fname.c_str(), &st) != 0) {
+    std::cout << "Error. Cannot find historic matches " << fname << std::endl;
+    return false;
+  }
+  if (readCache(fname + ".wcb", st.st_size, st.st_mtime)) return true;
+  if (!parseCSV(fname)) return false;
+  writeCache(fname + ".wcb", st.st_size, st.st_mtime);
+  return true;
+}
+
+// Fields are views into the mapped file, only new names are copied
+bool historicMatches::parseCSV(const std::string& fname) {
+  const int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Error. Cannot open historic matches " << fname << std::endl;
+    return false;
+  }
+  struct stat st;
+  fstat(fd, &st);
+  const size_t size = st.st_size;
+  void* map = (size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED);
+  close(fd);
+  if (map == MAP_FAILED) {
+    std::cout << "Error. Cannot map historic matches " << fname << std::endl;
+    return false;
+  }
+  madvise(map, size, MADV_SEQUENTIAL);
+  const char* p = static_cast<const char*>(map);
+  const char* const end = p + size;
+
+  m_names.clear();
+  m_matches.clear();
+  std::unordered_map<std::string_view, uint16_t> ids;
+  bool ok = true;
+  auto id = [&](std::string_view name) -> uint16_t {
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+    if (m_names.size() > UINT16_MAX) ok = false;
+    m_names.emplace_back(name);
+    return ids[name] = m_names.size() - 1;
+  };
+
+  std::string_view field[6];
+  while (p < end && ok) {
+    int n = 0;
+    while (p < end && *p != '\n') { // One field per pass
+      const char* start = p;
+      if (*p == '"') { // Quoted, commas inside are kept
+        start = ++p;
+        while (p < end && *p != '"') ++p;
+        if (n < 6) field[n] = std::string_view(start, p - start);
+        while (p < end && *p != ',' && *p != '\n') ++p;
+      } else {
+        while (p < end && *p != ',' && *p != '\n' && *p != '\r') ++p;
+        if (n < 6) field[n] = std::string_view(start, p - start);
+        while (p < end && *p != ',' && *p != '\n') ++p;
+      }
+      ++n;
+      if (p < end && *p == ',') ++p;
+    }
+    if (p < end) ++p; // The newline
+    if (n < 6) continue;
+    const uint32_t date = dateOf(field[0]); // Also skips the header
+    const int goalsA = goalsOf(field[3]), goalsB = goalsOf(field[4]);
+    if (date == 0 || goalsA < 0 || goalsB < 0) continue;
+    m_matches.push_back(historicMatch{date, id(field[1]), id(field[2]), id(field[5]), (uint8_t) goalsA, (uint8_t) goalsB});
+  }
+  munmap(map, size);
+  if (!ok) {
+    std::cout << "Error. Too many teams and competitions in " << fname << std::endl;
+    return false;
+  }
+  std::cout << "Parsed " << m_matches.size() << " historic matches from " << fname << std::endl;
+  return true;
+}
+
+bool historicMatches::readCache(const std::string& fname, const uint64_t csvSize, const int64_t csvTime) {
+  FILE* f = fopen(fname.c_str(), "rb");
+  if (f == nullptr) return false;
+  historicCacheHeader header;
+  bool ok = (fread(&header, sizeof(header), 1, f) == 1 && memcmp(header.magic, kHistoricMagic, sizeof(kHistoricMagic)) == 0
+    && header.version == kHistoricVersion && header.csvSize == csvSize && header.csvTime == csvTime
+    && header.nNames <= UINT16_MAX + 1u && header.nMatches <= csvSize); // Every match takes more than a byte of CSV
+  m_names.assign(ok ? header.nNames : 0, "");
+  for (std::string& name : m_names) {
+    uint32_t length = 0;
+    ok = ok && fread(&length, sizeof(length), 1, f) == 1 && length <= kHistoricMaxName;
+    if (!ok) break;
+    name.assign(length, ' ');
+    ok = (fread(&name[0], 1, length, f) == length);
+  }
+  m_matches.resize(ok ? header.nMatches : 0);
+  ok = ok && fread(m_matches.data(), sizeof(historicMatch), m_matches.size(), f) == m_matches.size();
+  for (const historicMatch& m : m_matches) {
+    if (!ok) break;
+    ok = (m.teamA < m_names.size() && m.teamB < m_names.size() && m.competition < m_names.size());
+  }
+  fclose(f);
+  if (!ok) {
+    m_names.clear();
+    m_matches.clear();
+    return false;
+  }
+  std::cout << "Loaded " << m_matches.size() << " historic matches from " << fname << std::endl;
+  return true;
+}
+
+void historicMatches::writeCache(const std::string& fname, const uint64_t csvSize, const int64_t csvTime) const {
+  FILE* f = fopen(fname.c_str(), "wb");
+  if (f == nullptr) {
+    std::cout << "Error. Cannot write historic matches cache " << fname << std::endl;
+    return;
+  }
+  historicCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kHistoricMagic, sizeof(kHistoricMagic));
+  header.version = kHistoricVersion;
+  header.nNames = m_names.size();
+  header.nMatches = m_matches.size();
+  header.csvSize = csvSize;
+  header.csvTime = csvTime;
+  bool ok = (fwrite(&header, sizeof(header), 1, f) == 1);
+  for (const std::string& name : m_names) {
+    const uint32_t length = std::min(name.size(), (size_t) kHistoricMaxName);
+    ok = ok && fwrite(&length, sizeof(length), 1, f) == 1 && fwrite(name.data(), 1, length, f) == length;
+  }
+  ok = ok && fwrite(m_matches.data(), sizeof(historicMatch), m_matches.size(), f) == m_matches.size();
+  if (fclose(f) != 0 || !ok) {
+    std::cout << "Error. Cannot write historic matches cache " << fname << std::endl;
+    remove(fname.c_str());
+  }
+}
+
+int historicMatches::nameId(const std::string& name) const {
+  const auto it = std::find(m_names.begin(), m_names.end(), name);
+  return (it == m_names.end() ? -1 : it - m_names.begin());
+}
+
+std::vector<uint32_t> historicMatches::select(const historicFilter& filter) const {
+  std::vector<bool> competition(m_names.size(), filter.competitions.empty()), team(m_names.size(), filter.teams.empty());
+  for (const std::string& name : filter.competitions) {
+    const int id = nameId(name);
+    if (id < 0) std::cout << "No historic matches in competition '" << name << "'" << std::endl;
+    else competition.at(id) = true;
+  }
+  for (const std::string& name : filter.teams) {
+    const int id = nameId(name);
+    if (id < 0) std::cout << "No historic matches for team '" << name << "'" << std::endl;
+    else team.at(id) = true;
+  }
+  std::vector<uint32_t> selected;
+  for (uint32_t i = 0; i < m_matches.size(); ++i) {
+    const historicMatch& m = m_matches[i];
+    if (m.date >= filter.from && m.date <= filter.to && competition[m.competition] && (team[m.teamA] || team[m.teamB])) selected.push_back(i);
+  }
+  return selected;
+}
+
+void historicMatches::countGoals(const std::vector<uint32_t>& selected, std::vector<long>& goals, std::vector<long>& goalDiff) const {
+  const unsigned nThreads = std::max(std::min(std::thread::hardware_concurrency(), (unsigned) (selected.size() / kHistoricMatchesPerThread)), 1u);
+  std::vector<std::vector<long>> threadGoals(nThreads, std::vector<long>(kHistoricMaxGoals + 1)), threadDiff = threadGoals;
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < nThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      const size_t first = selected.size() * t / nThreads, last = selected.size() * (t + 1) / nThreads;
+      std::vector<long>& g = threadGoals.at(t);
+      std::vector<long>& d = threadDiff.at(t);
+      for (size_t i = first; i < last; ++i) {
+        const historicMatch& m = m_matches[selected[i]];
+        ++g[std::min(m.goalsA + m.goalsB, kHistoricMaxGoals)];
+        ++d[std::min(abs(m.goalsA - m.goalsB), kHistoricMaxGoals)];
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  goals.assign(kHistoricMaxGoals + 1, 0);
+  goalDiff.assign(kHistoricMaxGoals + 1, 0);
+  for (unsigned t = 0; t < nThreads; ++t) {
+    for (int i = 0; i <= kHistoricMaxGoals; ++i) {
+      goals[i] += threadGoals[t][i];
+      goalDiff[i] += threadDiff[t][i];
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#ifndef WCMC_HISTORICMATCHES_H
+#define WCMC_HISTORICMATCHES_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Large databases of international results for training, as CSV with the columns
+//   date,home_team,away_team,home_score,away_score,tournament[,...]
+// The CSV is mapped and tokenised in place, the parsed matches are cached next to it in <csv>.wcb and reloaded
+// from there while the CSV's size and modification time are unchanged. Rows without a score are skipped.
+
+const uint32_t kHistoricVersion = 1;
+const int kHistoricMaxGoals = 16; // Goal counts at or above this are added together
+
+struct historicMatch {
+  uint32_t date; // yyyymmdd
+  uint16_t teamA;
+  uint16_t teamB;
+  uint16_t competition;
+  uint8_t goalsA;
+  uint8_t goalsB;
+};
+
+struct historicFilter {
+  uint32_t from = 0; // yyyymmdd, inclusive
+  uint32_t to = 99999999;
+  std::vector<std::string> competitions; // Any of, all if empty
+  std::vector<std::string> teams; // Either side is any of, all if empty
+};
+
+class historicMatches {
+public:
+  bool load(const std::string& fname);
+  size_t size() const { return m_matches.size(); }
+  std::vector<uint32_t> select(const historicFilter& filter) const;
+  // Total goals and absolute goal difference of the selected matches, counted in parallel
+  void countGoals(const std::vector<uint32_t>& selected, std::vector<long>& goals, std::vector<long>& goalDiff) const;
+
+  static uint32_t parseDate(const std::string& date); // YYYY-MM-DD, 0 if not a date
+
+private:
+  bool parseCSV(const std::string& fname);
+  bool readCache(const std::string& fname, const uint64_t csvSize, const int64_t csvTime);
+  void writeCache(const std::string& fname, const uint64_t csvSize, const int64_t csvTime) const;
+  int nameId(const std::string& name) const;
+
+  std::vector<std::string> m_names; // Teams and competitions
+  std::vector<historicMatch> m_matches;
+};
+
+#endif // WCMC_HISTORICMATCHES_H
@@ -0,0 +1,122 @@
+#include "htmlReport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace {
+  const int kCell = 16; // Heatmap cell, pixels
+  const int kBarHeight = 12;
+  const int kBarLength = 240;
+  const int kLabelWidth = 48;
+
+  std::string escape(const std::string& s) {
+    std::string out;
+    for (const char c : s) {
+      switch (c) {
+        case '&': out += "&amp;"; break;
+        case '<': out += "&lt;"; break;
+        case '>': out += "&gt;"; break;
+        case '"': out += "&quot;"; break;
+        default: out += c;
+      }
+    }
+    return out;
+  }
+
+  std::string percent(const double p) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), (p > 0 && p < 0.001 ? "%.2f%%" : "%.1f%%"), 100. * p);
+    return buf;
+  }
+
+  // White to dark blue, square root so that the tails are still visible
+  std::string shade(const double f) {
+    const double s = std::sqrt(std::min(std::max(f, 0.), 1.));
+    char buf[8];
+    snprintf(buf, sizeof(buf), "#%02x%02x%02x", (int)(255 - s * (255 - 8)), (int)(255 - s * (255 - 48)), (int)(255 - s * (255 - 107)));
+    return buf;
+  }
+}
+
+void htmlReport::closeSection() {
+  if (m_open) m_body << "</div>\n";
+  m_open = false;
+}
+
+void htmlReport::section(const std::string& heading) {
+  closeSection();
+  m_body << "<h2>" << escape(heading) << "</h2>\n<div class=\"row\">\n";
+  m_open = true;
+}
+
+void htmlReport::text(const std::string& text) {
+  closeSection();
+  m_body << "<p>" << escape(text) << "</p>\n";
+}
+
+void htmlReport::bars(const std::string& title, const std::vector<std::string>& labels, const std::vector<double>& values) {
+  const int width = kLabelWidth + kBarLength + 48, height = kBarHeight * labels.size();
+  m_body << "<figure><figcaption>" << escape(title) << "</figcaption>"
+    << "<svg width=\"" << width << "\" height=\"" << height << "\">";
+  for (size_t i = 0; i < labels.size(); ++i) {
+    const double p = (i < values.size() ? values.at(i) : 0.);
+    const int y = kBarHeight * i;
+    m_body << "<text x=\"" << kLabelWidth - 4 << "\" y=\"" << y + kBarHeight - 2 << "\" text-anchor=\"end\">" << escape(labels.at(i)) << "</text>"
+      << "<rect class=\"bar\" x=\"" << kLabelWidth << "\" y=\"" << y + 1 << "\" width=\"" << std::lround(kBarLength * std::min(std::max(p, 0.), 1.))
+      << "\" height=\"" << kBarHeight - 2 << "\"/>"
+      << "<text x=\"" << width - 2 << "\" y=\"" << y + kBarHeight - 2 << "\" text-anchor=\"end\">" << percent(p) << "</text>";
+  }
+  m_body << "</svg></figure>\n";
+}
+
+void htmlReport::heatmap(const std::string& title, const std::string& xTitle, const std::string& yTitle,
+  const std::vector<std::string>& xLabels, const std::vector<std::string>& yLabels, const std::vector<double>& values, const bool numbers) {
+  const int nx = xLabels.size(), ny = yLabels.size();
+  const int cellX = (numbers ? 3 * kCell : kCell);
+  const int left = kLabelWidth, bottom = 2 * kCell;
+  const int width = left + nx * cellX + 4, height = ny * kCell + bottom;
+  double max = 0;
+  for (const double v : values) max = std::max(max, v);
+  m_body << "<figure><figcaption>" << escape(title) << "</figcaption>"
+    << "<svg width=\"" << width << "\" height=\"" << height << "\">"
+    << "<rect x=\"" << left << "\" y=\"0\" width=\"" << nx * cellX << "\" height=\"" << ny * kCell << "\" fill=\"#fff\" stroke=\"#ccc\"/>";
+  for (int j = 0; j < ny; ++j) {
+    const int y = (ny - 1 - j) * kCell;
+    m_body << "<text x=\"" << left - 4 << "\" y=\"" << y + kCell - 4 << "\" text-anchor=\"end\">" << escape(yLabels.at(j)) << "</text>";
+    for (int i = 0; i < nx; ++i) {
+      const size_t cell = j * nx + i;
+      const double v = (cell < values.size() ? values.at(cell) : 0.);
+      if (v <= 0) continue; // Left as background
+      const int x = left + i * cellX;
+      m_body << "<rect x=\"" << x << "\" y=\"" << y << "\" width=\"" << cellX << "\" height=\"" << kCell << "\" fill=\"" << shade(v / max) << "\">"
+        << "<title>" << escape(xLabels.at(i)) << ", " << escape(yLabels.at(j)) << ": " << percent(v) << "</title></rect>";
+      if (numbers) {
+        m_body << "<text x=\"" << x + cellX / 2 << "\" y=\"" << y + kCell - 4 << "\" text-anchor=\"middle\"" << (v > max / 2 ? " fill=\"#fff\"" : "") << ">"
+          << percent(v) << "</text>";
+      }
+    }
+  }
+  for (int i = 0; i < nx; ++i) {
+    m_body << "<text x=\"" << left + i * cellX + cellX / 2 << "\" y=\"" << ny * kCell + kCell - 4 << "\" text-anchor=\"middle\">" << escape(xLabels.at(i)) << "</text>";
+  }
+  m_body << "<text x=\"" << left + nx * cellX / 2 << "\" y=\"" << height - 4 << "\" text-anchor=\"middle\">" << escape(xTitle) << "</text>"
+    << "<text x=\"2\" y=\"" << ny * kCell + kCell - 4 << "\">" << escape(yTitle) << "</text>"
+    << "</svg></figure>\n";
+}
+
+bool htmlReport::write(const std::string& fname) {
+  closeSection();
+  std::ofstream out(fname);
+  if (!out) {
+    std::cout << "Error. Cannot write report to " << fname << std::endl;
+    return false;
+  }
+  out << "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>" << escape(m_title) << "</title>\n"
+    << "<style>body{font-family:sans-serif;margin:1em}.row{display:flex;flex-wrap:wrap}"
+    << "figure{margin:.5em}figcaption{font-size:13px;font-weight:bold}svg text{font-size:10px}.bar{fill:#2171b5}</style>\n"
+    << "</head><body>\n<h1>" << escape(m_title) << "</h1>\n" << m_body.str() << "</body></html>\n";
+  return (bool)out;
+}
@@ -0,0 +1,32 @@
+#ifndef WCMC_HTMLREPORT_H
+#define WCMC_HTMLREPORT_H
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+// A single self-contained HTML page of inline SVG charts, drawn straight from the numbers with no canvas involved.
+// Charts are appended in order, each section starts a new row of figures.
+
+class htmlReport {
+public:
+  htmlReport(const std::string& title) : m_title(title), m_open(false) {}
+
+  void section(const std::string& heading);
+  void text(const std::string& text);
+  // Horizontal bars of probabilities in [0, 1], one per label
+  void bars(const std::string& title, const std::vector<std::string>& labels, const std::vector<double>& values);
+  // values are row-major with one row per yLabel, the first row is drawn at the bottom. Shaded relative to the largest value.
+  void heatmap(const std::string& title, const std::string& xTitle, const std::string& yTitle,
+    const std::vector<std::string>& xLabels, const std::vector<std::string>& yLabels, const std::vector<double>& values, const bool numbers);
+  bool write(const std::string& fname);
+
+private:
+  void closeSection();
+
+  std::string m_title;
+  std::ostringstream m_body;
+  bool m_open;
+};
+
+#endif // WCMC_HTMLREPORT_H
@@ -0,0 +1,133 @@
+#include "logger.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+
+static const std::chrono::microseconds kLogIdleSleep(200); // Sink thread poll, and flush wait, when the queue is empty
+
+logger& logger::get() {
+  static logger instance;
+  return instance;
+}
+
+bool logger::parseLevel(const std::string& name, logLevel_t& level) {
+  static const char* const kNames[] = {"error", "warning", "info", "debug"};
+  for (int l = kLogError; l <= kLogDebug; ++l) {
+    if (name == kNames[l]) {
+      level = (logLevel_t) l;
+      return true;
+    }
+  }
+  return false;
+}
+
+logger::logger() : m_level(kLogInfo), m_dropped(0), m_enqueue(0), m_dequeue(0), m_written(0), m_running(false), m_stop(false), m_sink(nullptr) {
+  m_cells.reset(new cell[kLogQueueSize]);
+  for (size_t i = 0; i < kLogQueueSize; ++i) m_cells[i].sequence.store(i, std::memory_order_relaxed);
+  m_block.reserve(2 * kLogBlockSize);
+  pthread_atfork(&logger::beforeFork, nullptr, &logger::afterForkChild);
+}
+
+logger::~logger() {
+  if (m_running.load()) {
+    m_stop.store(true);
+    m_sink->join();
+    delete m_sink;
+  }
+  if (dropped() > 0) fprintf(stderr, "Log queue was full, %lu messages were dropped\n", (unsigned long) dropped());
+}
+
+void logger::start() {
+  std::lock_guard<std::mutex> lock(m_startMutex);
+  if (m_running.load()) return;
+  m_stop.store(false);
+  m_sink = new std::thread(&logger::run, this);
+  m_running.store(true);
+}
+
+logger::cell* logger::claim(size_t& position) {
+  if (!m_running.load(std::memory_order_acquire)) start();
+  position = m_enqueue.load(std::memory_order_relaxed);
+  while (true) {
+    cell* c = &m_cells[position & (kLogQueueSize - 1)];
+    const intptr_t diff = (intptr_t) c->sequence.load(std::memory_order_acquire) - (intptr_t) position;
+    if (diff == 0) {
+      if (m_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) return c;
+    } else if (diff < 0) { // Still being written out from the previous lap
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    } else {
+      position = m_enqueue.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void logger::run() {
+  while (true) {
+    cell& c = m_cells[m_dequeue & (kLogQueueSize - 1)];
+    if (c.sequence.load(std::memory_order_acquire) == m_dequeue + 1) {
+      format(c.record);
+      c.sequence.store(m_dequeue + kLogQueueSize, std::memory_order_release); // Free for the next lap
+      ++m_dequeue;
+      if (m_block.size() >= kLogBlockSize) write();
+      continue;
+    }
+    // Idle, a claimed message still being filled in counts as idle too
+    write();
+    m_written.store(m_dequeue, std::memory_order_release);
+    if (m_stop.load() && m_dequeue == m_enqueue.load()) return;
+    std::this_thread::sleep_for(kLogIdleSleep);
+  }
+}
+
+void logger::flush() {
+  if (!m_running.load()) return;
+  const size_t target = m_enqueue.load();
+  while (m_written.load(std::memory_order_acquire) < target) std::this_thread::sleep_for(kLogIdleSleep);
+}
+
+void logger::write() {
+  if (m_block.empty()) return;
+  fwrite(m_block.data(), 1, m_block.size(), stdout);
+  fflush(stdout);
+  m_block.clear();
+}
+
+void logger::format(const logRecord& r) {
+  char number[32];
+  int arg = 0;
+  for (const char* p = r.format; *p != '\0'; ++p) {
+    if (*p != '{' || arg >= r.nArgs) {
+      m_block += *p;
+      continue;
+    }
+    const char* close = strchr(p, '}');
+    if (close == nullptr) {
+      m_block += p;
+      break;
+    }
+    int precision = 6;
+    if (p[1] == '.') precision = atoi(p + 2);
+    const logArg& a = r.args[arg++];
+    switch (a.type) {
+      case logArg::kInt:    snprintf(number, sizeof(number), "%lld", a.i); m_block += number; break;
+      case logArg::kDouble: snprintf(number, sizeof(number), "%.*g", precision, a.d); m_block += number; break;
+      case logArg::kString: m_block += a.s; break;
+    }
+    p = close;
+  }
+  m_block += '\n';
+}
+
+// Forked children, e.g. the backtest, get an empty queue and start their own sink
+void logger::beforeFork() {
+  get().flush();
+}
+
+void logger::afterForkChild() {
+  logger& l = get();
+  l.m_sink = nullptr; // The thread is not copied into the child
+  l.m_running.store(false);
+}
@@ -0,0 +1,121 @@
+#ifndef WCMC_LOGGER_H
+#define WCMC_LOGGER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+// Levelled logging that never waits on the output. A message is its format literal plus copies of its arguments, claimed
+// in a bounded lock-free queue by any thread. A background thread formats the messages and writes them to stdout in blocks.
+//   LOG_INFO("Trial:{} winner {}", trial, name);   "{}" is the next argument, "{.4}" a floating point one to 4 digits
+//   logger::get().flush();                          Wait for the queue to be written, e.g. before printing with std::cout
+// A message is dropped, and counted, if the queue is full.
+
+enum logLevel_t {kLogError, kLogWarning, kLogInfo, kLogDebug};
+
+const int kLogMaxArgs = 6;
+const int kLogStringLength = 72; // Longer string arguments are truncated, outcome keys fit
+const size_t kLogQueueSize = 1 << 12; // Messages, a power of two
+const size_t kLogBlockSize = 1 << 16; // Bytes written at a time
+
+struct logArg {
+  enum type_t {kInt, kDouble, kString};
+  type_t type;
+  union {
+    long long i;
+    double d;
+    char s[kLogStringLength];
+  };
+};
+
+struct logRecord {
+  const char* format;
+  int nArgs;
+  logArg args[kLogMaxArgs];
+};
+
+class logger {
+public:
+  static logger& get();
+  static bool parseLevel(const std::string& name, logLevel_t& level); // error, warning, info or debug
+
+  void setLevel(const logLevel_t level) { m_level.store(level, std::memory_order_relaxed); }
+  bool enabled(const logLevel_t level) const { return level <= m_level.load(std::memory_order_relaxed); }
+  uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+  template <size_t N, typename... Args>
+  void log(const logLevel_t level, const char (&format)[N], const Args&... args) {
+    static_assert(sizeof...(Args) <= kLogMaxArgs, "Too many arguments to log");
+    if (!enabled(level)) return;
+    size_t position;
+    cell* c = claim(position);
+    if (c == nullptr) return;
+    logRecord& r = c->record;
+    r.format = format;
+    r.nArgs = 0;
+    (setArg(r.args[r.nArgs++], args), ...);
+    c->sequence.store(position + 1, std::memory_order_release); // Hand over to the sink
+  }
+
+  void flush(); // Returns once everything logged so far is written
+
+private:
+  struct cell {
+    std::atomic<size_t> sequence; // position when free, position + 1 when written, as Vyukov's bounded queue
+    logRecord record;
+  };
+
+  logger();
+  ~logger();
+  void start();
+  cell* claim(size_t& position);
+  void run(); // The sink thread
+  void format(const logRecord& r);
+  void write();
+  static void beforeFork();
+  static void afterForkChild();
+
+  template <typename T>
+  static void setArg(logArg& a, const T& value) {
+    if constexpr (std::is_integral_v<T>) {
+      a.type = logArg::kInt;
+      a.i = value;
+    } else if constexpr (std::is_floating_point_v<T>) {
+      a.type = logArg::kDouble;
+      a.d = value;
+    } else {
+      setString(a, std::string_view(value));
+    }
+  }
+  static void setString(logArg& a, const std::string_view s) {
+    const size_t n = std::min(s.size(), (size_t) kLogStringLength - 1);
+    a.type = logArg::kString;
+    memcpy(a.s, s.data(), n);
+    a.s[n] = '\0';
+  }
+
+  std::atomic<int> m_level;
+  std::atomic<uint64_t> m_dropped;
+  std::unique_ptr<cell[]> m_cells;
+  std::atomic<size_t> m_enqueue; // Next position to claim
+  size_t m_dequeue; // Sink thread only
+  std::atomic<size_t> m_written; // Positions before this are on stdout
+  std::string m_block; // Sink thread only
+  std::atomic<bool> m_running, m_stop;
+  std::thread* m_sink;
+  std::mutex m_startMutex;
+};
+
+#define LOG_ERROR(...) logger::get().log(kLogError, __VA_ARGS__)
+#define LOG_WARNING(...) logger::get().log(kLogWarning, __VA_ARGS__)
+#define LOG_INFO(...) logger::get().log(kLogInfo, __VA_ARGS__)
+#define LOG_DEBUG(...) logger::get().log(kLogDebug, __VA_ARGS__)
+
+#endif // WCMC_LOGGER_H
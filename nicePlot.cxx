@@ -4,12 +4,14 @@
 // -------------------------------------------------------------
 
 #include "nicePlot.h"
+#include "pdfMerge.h"
 
 #include <vector>
 #include <cmath>
 #include <set>
 #include <sstream>
 #include <algorithm>
+#include <fstream>
 #include <TF1.h>
 #include <TProfile.h>
 #include <TH1F.h>
@@ -29,9 +31,18 @@
 #include <TSystem.h>
 #include <TLine.h>
 #include <TError.h>
+#include <TROOT.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 std::vector<nicePlot*> bookOutput::rp;
+std::vector<TCanvas*> bookOutput::multiPads;
 unsigned bookOutput::_break = 9999;
+unsigned bookOutput::_formats = kDefaultFormats;
+unsigned bookOutput::_workers = 0;
+bool bookOutput::_incremental = true;
+
+const unsigned long long kPlotHashVersion = 1; // Bump when the drawing code changes what a page looks like
 
 void err(TString e) {
   std::cout <<  "\033[1;31m ERROR:" << e << "\033[0m\n";
@@ -56,6 +67,31 @@ nicePlot::nicePlot(nicePlot* _copy) {
   copy(*_copy);
 }
 
+nicePlot::~nicePlot() {
+  unbook();
+  release();
+}
+
+// Stack first (it does not own its histograms), then the graphs, frames and decorations in reverse order
+// so each leaves its pad's list of primitives, then the pads and canvas
+void nicePlot::release() {
+  delete ownedStack;
+  for (auto _o = owned.rbegin(); _o != owned.rend(); ++_o) delete *_o;
+  for (auto _p = ownedPads.rbegin(); _p != ownedPads.rend(); ++_p) delete *_p;
+  owned.clear();
+  ownedPads.clear();
+  dataSyst.clear();
+  dataStat.clear();
+  mc.clear();
+  mc_do.clear();
+  ratio.clear();
+  ratioIsDataStyle.clear();
+  plot2D = nullptr;
+  mc_stack = ownedStack = nullptr;
+  c = nullptr;
+  _frame_top = _frame_bot = nullptr;
+}
+
 void nicePlot::reset() {
   normAlreadDone = false;
   isReg = false;
@@ -63,7 +99,8 @@ void nicePlot::reset() {
   line_width = 1;
   divideBinWidth = ratioOnly = includeBothInRatioError = killLowStatBins = false;
   legendX = legendY = 0.5;
-  logX = logY = logZ = norm_ndc = false;
+  legendScale = 1;
+  logX = logY = logZ = logR = norm_ndc = false;
   xMin = xMax = yMin = yMax = rMin = rMax = 0;
   useAltColourScheme(0);
   n_mc = 0;
@@ -89,6 +126,38 @@ void nicePlot::reset() {
   titleOffsetMod = 0;
 }
 
+void nicePalette::registerColours() {
+  static bool doOnce = true;
+  int ci;
+  if (doOnce == true) {
+    doOnce = false;
+    ci = 2555;
+    new TColor(++ci, 22/256., 147/256., 167/256.); // blueLagoon
+    new TColor(++ci, 200/256., 207/256., 2/256.); // springWind
+    new TColor(++ci, 204/256., 12/256., 57/256.); // kaaskopPink
+    new TColor(++ci, 230/256., 120/256., 30/256.); // orangeSakura
+    new TColor(++ci, 167/256., 2/256., 103/256.); // mai
+    new TColor(++ci, 14/256., 78/256., 173/256.); // skyblue
+    new TColor(++ci, 131/256., 163/256., 0/256.); // kotak
+    gStyle->SetHatchesLineWidth(2);
+    //gStyle->SetHatchesSpacing(0.05);
+  }
+}
+
+// The gradient is built once, later calls re-select it (e.g. after a plot switched to palette 53)
+void nicePalette::useCool() {
+  static std::vector<int> _palette;
+  if (_palette.empty()) {
+    Double_t stops[9] = { 0.0000, 0.1250, 0.2500, 0.3750, 0.5000, 0.6250, 0.7500, 0.8750, 1.0000};
+    Double_t red[9]   = { 0/255., 51./255.,  43./255.,  33./255.,  28./255.,  35./255.,  74./255., 144./255., 246./255.};
+    Double_t green[9] = { 0/255., 24./255.,  55./255.,  87./255., 118./255., 150./255., 180./255., 200./255., 222./255.};
+    Double_t blue[9]  = { 0/255., 96./255., 112./255., 114./255., 112./255., 101./255.,  72./255.,  35./255.,   0./255.};
+    const int _first = TColor::CreateGradientColorTable(9, stops, red, green, blue, 255);
+    for (int _i = 0; _i < 255; ++_i) _palette.push_back(_first + _i);
+  }
+  gStyle->SetPalette(_palette.size(), _palette.data());
+}
+
 void nicePlot::init(TString _xTitle, TString _yTitle, TString _rTitle, bool quiet) {
   book();
   xTitle = _xTitle; yTitle = _yTitle; rTitle = _rTitle;
@@ -110,21 +179,8 @@ void nicePlot::unbook() {
 }
 
 void nicePlot::useAltColourScheme(int _i) {
-  static bool doOnce = true;
+  nicePalette::registerColours();
   int ci;
-  if (doOnce == true) {
-    doOnce = false;
-    ci = 2555;
-    new TColor(++ci, 22/256., 147/256., 167/256.); // blueLagoon
-    new TColor(++ci, 200/256., 207/256., 2/256.); // springWind
-    new TColor(++ci, 204/256., 12/256., 57/256.); // kaaskopPink
-    new TColor(++ci, 230/256., 120/256., 30/256.); // orangeSakura
-    new TColor(++ci, 167/256., 2/256., 103/256.); // mai
-    new TColor(++ci, 14/256., 78/256., 173/256.); // skyblue
-    new TColor(++ci, 131/256., 163/256., 0/256.); // kotak
-    gStyle->SetHatchesLineWidth(2);
-    //gStyle->SetHatchesSpacing(0.05);
-  }
   switch (_i) {
     case 0: // default
     data_col[0] = kGreen-6;
@@ -361,7 +417,7 @@ void nicePlot::addLine(double _x1, double _y1, double  _x2, double _y2, int _lin
 nicePlot* nicePlot::addData(TGraphAsymmErrors* _gStat, TString _name, bool _ratioWithData) {
   if (_gStat == nullptr) { err("no data graph pointer");  return this; }
   if (dataSyst.size() >= n_sty) { err("Too much data"); return this; }
-  TGraphAsymmErrors* _gSyst = (TGraphAsymmErrors*) _gStat->Clone();
+  TGraphAsymmErrors* _gSyst = own( (TGraphAsymmErrors*) _gStat->Clone() );
   _gSyst->SetFillColor(data_col[  dataSyst.size() ]);
   _gSyst->SetFillStyle(data_fill[ dataSyst.size() ]);
   _gSyst->SetTitle(_name);
@@ -395,9 +451,9 @@ nicePlot* nicePlot::addData(TGraphAsymmErrors* _gStat, TString _name, bool _rati
 
 nicePlot* nicePlot::addData(TH1* _hStat, TString _name, float _norm, bool _ratioWithData) {
   if (_hStat == nullptr) { err("Null ptr"); return this; }
-  TH1* _cloneStat = static_cast<TH1*>(_hStat->Clone());
+  TH1* _cloneStat = own( static_cast<TH1*>(_hStat->Clone()) );
   applyOptionsToHist(_cloneStat, _norm);
-  return addData(new TGraphAsymmErrors(_cloneStat), _name, _ratioWithData);
+  return addData(own( new TGraphAsymmErrors(_cloneStat) ), _name, _ratioWithData);
 }
 
 nicePlot* nicePlot::addData(TFile* _f, TString _hist_name_in_file, TString _name, float _norm, bool _ratioWithData) {
@@ -419,8 +475,8 @@ nicePlot* nicePlot::addDataSystematic(TGraphAsymmErrors* _gSyst, TGraphAsymmErro
 nicePlot* nicePlot::addDataSystematic(TH1* _hSyst, TH1* _hNominal, bool _symmetrise) {
   if (_hSyst == nullptr) { err("Null ptr"); return this; }
   TGraphAsymmErrors* _gNominal = nullptr;
-  if (_hNominal != nullptr) _gNominal = new TGraphAsymmErrors(_hNominal);
-  return addDataSystematic(new TGraphAsymmErrors(_hSyst), _gNominal, _symmetrise);
+  if (_hNominal != nullptr) _gNominal = own( new TGraphAsymmErrors(_hNominal) );
+  return addDataSystematic(own( new TGraphAsymmErrors(_hSyst) ), _gNominal, _symmetrise);
 }
 
 nicePlot* nicePlot::addDataSystematic(TFile* _f, TString _syst_name_in_file, bool _symmetrise) {
@@ -446,7 +502,7 @@ nicePlot* nicePlot::addDataSystematic(TFile* _f, TString _syst_name_in_file, TSt
 nicePlot* nicePlot::add2D(TH2* _h) {
   if (_h == nullptr) return this;
   if (plot2D != nullptr) { err("Already have a plot2D"); return this; }
-  TH2* _clone = static_cast<TH2*>(_h->Clone());
+  TH2* _clone = own( static_cast<TH2*>(_h->Clone()) );
 
   if (_clone->GetMaximum() > 1) {
     double _minval = 999.;
@@ -483,7 +539,7 @@ nicePlot* nicePlot::add2DEfficiency(TFile* _f, TString _hist_name_in_file_1, TSt
 
   TH2* _a = static_cast<TH2*>(_o1);
   TH2* _b = static_cast<TH2*>(_o2);
-  TH2* _c = static_cast<TH2*>( _a->Clone() );
+  TH2* _c = own( static_cast<TH2*>( _a->Clone() ) );
   _c->Divide(_b);
   // Bins missing entires in either hist have zero efficiency
   for (int bin = 0; bin < _a->GetNcells(); ++bin) {
@@ -495,10 +551,10 @@ nicePlot* nicePlot::add2DEfficiency(TFile* _f, TString _hist_name_in_file_1, TSt
 nicePlot* nicePlot::addStackMC(TH1* _h, TString _name) {
   if (_h == 0) return this;
   if (mc_stack == nullptr) {
-    mc_stack = new THStack("", "");
+    mc_stack = ownedStack = new THStack("", "");
   }
 
-  TH1* _clone = static_cast<TH1*>(_h->Clone());
+  TH1* _clone = own( static_cast<TH1*>(_h->Clone()) );
   applyOptionsToHist(_clone, 1);
 
   int _n = n_mc;
@@ -564,9 +620,9 @@ nicePlot* nicePlot::addMC(TGraphAsymmErrors* _g, TString _name, bool _ratioWithD
 
 nicePlot* nicePlot::addMC(TH1* _h, TString _name, bool _ratioWithData, float _norm) {
   if (_h == 0) return this;
-  TH1* _clone = static_cast<TH1*>(_h->Clone());
+  TH1* _clone = own( static_cast<TH1*>(_h->Clone()) );
   applyOptionsToHist(_clone, _norm);
-  return addMC(new TGraphAsymmErrors(_clone), _name, _ratioWithData);
+  return addMC(own( new TGraphAsymmErrors(_clone) ), _name, _ratioWithData);
 }
 
 nicePlot* nicePlot::addMC(TFile* _f, TString _hist_name_in_file, TString _name, bool _ratioWithData, float _norm) {
@@ -646,12 +702,12 @@ void nicePlot::graphAddSyst(TGraphAsymmErrors* _gSyst, TGraphAsymmErrors* _gNomi
 
 nicePlot* nicePlot::addRatio(TH1* _mc, TH1* _data, int mcColourOffset) {
   if (_mc == nullptr || _data == nullptr) return this;
-  TH1* _clone1 = static_cast<TH1*>(_mc->Clone());
-  TH1* _clone2 = static_cast<TH1*>(_data->Clone());
+  TH1* _clone1 = own( static_cast<TH1*>(_mc->Clone()) );
+  TH1* _clone2 = own( static_cast<TH1*>(_data->Clone()) );
   applyOptionsToHist(_clone1);
   applyOptionsToHist(_clone2);
-  TGraphAsymmErrors* _mc_g = new TGraphAsymmErrors(_clone1);
-  TGraphAsymmErrors* _data_g = new TGraphAsymmErrors(_clone2);
+  TGraphAsymmErrors* _mc_g = own( new TGraphAsymmErrors(_clone1) );
+  TGraphAsymmErrors* _data_g = own( new TGraphAsymmErrors(_clone2) );
   int _n = n_mc;
   _n -= mcColourOffset;
   _mc_g->SetLineColor(mc_col[_n]);
@@ -665,7 +721,7 @@ nicePlot* nicePlot::addRatio(TH1* _mc, TH1* _data, int mcColourOffset) {
 nicePlot* nicePlot::addRatio(TGraphAsymmErrors* _mc, TGraphAsymmErrors* _data, bool isDataStyle) {
   if (_mc == 0 || _data == 0) return this;
   ratioIsDataStyle.push_back(isDataStyle);
-  ratio.push_back( graphDivide(_mc, _data, includeBothInRatioError) );
+  ratio.push_back( own( graphDivide(_mc, _data, includeBothInRatioError) ) );
   return this;
 }
 
@@ -706,28 +762,28 @@ nicePlot* nicePlot::addMCMCRatio(TFile* _f1, TString _hist_name_in_file_1, TFile
   if (_name == "") _name = _hist_name_in_file_1;
 
   if ( getObjectType(_o1) == kObjTypeTH1 ) {
-    TH1* clone1 = static_cast<TH1*>( _o1->Clone() );
-    TH1* clone2 = static_cast<TH1*>( _o2->Clone() );
+    TH1* clone1 = own( static_cast<TH1*>( _o1->Clone() ) );
+    TH1* clone2 = own( static_cast<TH1*>( _o2->Clone() ) );
     applyOptionsToHist(clone1);
     applyOptionsToHist(clone2);
     clone1->Divide( clone2 );
     normAlreadDone = true;
     addMC(clone1, _name, _ratioWithData);
   } else if ( getObjectType(_o1) == kObjTypeGraph ) {
-    TGraphAsymmErrors* clone = static_cast<TGraphAsymmErrors*>( _o1->Clone() );
-    addMC(graphDivide(clone, static_cast<TGraphAsymmErrors*>(_o2), includeBothInRatioError), _name, _ratioWithData);
+    TGraphAsymmErrors* clone = own( static_cast<TGraphAsymmErrors*>( _o1->Clone() ) );
+    addMC(own( graphDivide(clone, static_cast<TGraphAsymmErrors*>(_o2), includeBothInRatioError) ), _name, _ratioWithData);
   } else err("unsuported type");
   return this;
 }
 
 nicePlot* nicePlot::addMCMCRatio(TGraphAsymmErrors* _a, TGraphAsymmErrors* _b, TString _name, bool _ratioWithData) {
   if ( _a == nullptr || _b == nullptr) { err("nullptr in addMCMCRatio"); return this; }
-  return addMC(graphDivide(_a, _b, includeBothInRatioError), _name, _ratioWithData);
+  return addMC(own( graphDivide(_a, _b, includeBothInRatioError) ), _name, _ratioWithData);
 }
 
 nicePlot* nicePlot::addDataDataRatio(TGraphAsymmErrors* _a, TGraphAsymmErrors* _b, TString _name) {
   if ( _a == nullptr || _b == nullptr) { err("nullptr in addDataDataRatio"); return this; }
-  return addData(graphDivide(_a, _b, includeBothInRatioError), _name);
+  return addData(own( graphDivide(_a, _b, includeBothInRatioError) ), _name);
 }
 
 void nicePlot::applyOptionsToHist(TH1* _h, float _norm) {
@@ -809,7 +865,7 @@ void nicePlot::drawArrow(int i) {
     case kNPArrowUp:    _y2 = _y1 + ((yMax-yMin)/10.); break; // up
     case kNPArrowDown:  _y2 = _y1 - ((yMax-yMin)/10.);  break; // down
   }
-  TArrow* ar = new TArrow(_x1, _y1, _x2, _y2, 0.05, "|>");
+  TArrow* ar = own( new TArrow(_x1, _y1, _x2, _y2, 0.05, "|>") );
   // std::cout << "x1:" << _x1 << " x2:" << _x2 << " y1:" << _y1 << " y2:" << _y2 << std::endl;
   ar->SetAngle(30);
   ar->SetLineWidth(lineWidth.at(i));
@@ -832,7 +888,7 @@ TCanvas* nicePlot::getCanvas(TPad* _toDrawInto) {
 
   // CANVAS
   if (_toDrawInto == nullptr) {
-    c = new TCanvas();
+    c = ownPad( new TCanvas() );
     c->SetCanvasSize(800 * (stretch ? 2.5 : 1),600); // WC MC
     gPad->SetMargin(0,0,0,0);
     c->SetFillColor(1); // WC MC
@@ -949,7 +1005,7 @@ TCanvas* nicePlot::getCanvas(TPad* _toDrawInto) {
 
     // TOP FRAME
     if (!ratioOnly) {
-      _p1 = new TPad("","", xLow, yOffset, xUp, yUp);
+      _p1 = ownPad( new TPad("","", xLow, yOffset, xUp, yUp) );
       _p1->Draw();
       _p1->SetMargin(marginLeft, marginRight, 0, marginTop * (1./(1.-yOffset)));
       _p1->SetLogx(logX);
@@ -959,7 +1015,7 @@ TCanvas* nicePlot::getCanvas(TPad* _toDrawInto) {
     }
 
     // BOT FRAME
-    _p2 = new TPad("","",xLow, yLow, xUp, yOffset);
+    _p2 = ownPad( new TPad("","",xLow, yLow, xUp, yOffset) );
     _p2->Draw();
     _p2->SetMargin(marginLeft, marginRight, marginBottom * (1./yOffset), 0);
     if (ratioOnly) _p2->SetTopMargin(marginTop);
@@ -1013,7 +1069,7 @@ TCanvas* nicePlot::getCanvas(TPad* _toDrawInto) {
 
   } else if (plot2D != nullptr) { // 2D
 
-    TPad* _p1 = new TPad("","",0, 0, 1, 1);
+    TPad* _p1 = ownPad( new TPad("","",0, 0, 1, 1) );
     _p1->SetFillStyle(0);
     _p1->Draw();
     _p1->SetLogx(logX);
@@ -1049,16 +1105,7 @@ TCanvas* nicePlot::getCanvas(TPad* _toDrawInto) {
 
     } else {
 
-      // kCool
-      static bool doOnce = true;
-      if (doOnce == true) {
-        doOnce = false;
-        Double_t stops[9] = { 0.0000, 0.1250, 0.2500, 0.3750, 0.5000, 0.6250, 0.7500, 0.8750, 1.0000};
-        Double_t red[9]   = { 0/255., 51./255.,  43./255.,  33./255.,  28./255.,  35./255.,  74./255., 144./255., 246./255.};
-        Double_t green[9] = { 0/255., 24./255.,  55./255.,  87./255., 118./255., 150./255., 180./255., 200./255., 222./255.};
-        Double_t blue[9]  = { 0/255., 96./255., 112./255., 114./255., 112./255., 101./255.,  72./255.,  35./255.,   0./255.};
-        TColor::CreateGradientColorTable(9, stops, red, green, blue, 255);
-      }
+      nicePalette::useCool();
     }
     //
     plot2D->Draw("colz");
@@ -1074,7 +1121,7 @@ TCanvas* nicePlot::getCanvas(TPad* _toDrawInto) {
 
     // TOP FRAME
     // TODO extra y offset here too
-    TPad* _p1 = new TPad("","",0, 0, 1, 1);
+    TPad* _p1 = ownPad( new TPad("","",0, 0, 1, 1) );
     _p1->SetFillStyle(0);
     _p1->SetFillColor(1);
     _p1->Draw();
@@ -1126,7 +1173,7 @@ TCanvas* nicePlot::getCanvas(TPad* _toDrawInto) {
     if (fit != "") {
       float fit_y = 0.9;
       for (unsigned int i=0; i < mc.size(); ++i) {
-        TF1* fitFn = new TF1("",fit,fitMin,fitMax);
+        TF1* fitFn = own( new TF1("",fit,fitMin,fitMax) );
         // fitFn->SetParameters(1, 1, 30, 40); // Hack
         mc[i]->Fit(fitFn, "S0", "", fitMin, fitMax);
         TF1* myfit = fitFn;//mc[i]->GetFunction(fit);
@@ -1164,7 +1211,7 @@ TCanvas* nicePlot::getCanvas(TPad* _toDrawInto) {
       legendScale = ((_YSpaceUpper - legendY) / ( _entries * _YEntriesSpacing ));
       err("no room for legend ");
     }
-    TLegend* L = new TLegend(legendX, legendY, 1, legendY + (_YEntriesSpacing * _entries * legendScale) , "","NDC");
+    TLegend* L = own( new TLegend(legendX, legendY, 1, legendY + (_YEntriesSpacing * _entries * legendScale) , "","NDC") );
     L->SetTextFont(43);
     L->SetTextColor(0); // WC MC
     L->SetTextSize(24. * legendScale);
@@ -1190,7 +1237,7 @@ TCanvas* nicePlot::getCanvas(TPad* _toDrawInto) {
     // X AXIS BIN LABELS
     if ( bin_label_x.size() > 0 ) setBinLabels( _frame_bot, "x");
 
-    TLine* _l = new TLine();
+    TLine* _l = own( new TLine() );
     _l->SetLineStyle(3);
     _l->DrawLine(xMin, ratioLineValue, xMax, ratioLineValue);
 
@@ -1221,7 +1268,7 @@ TCanvas* nicePlot::getCanvas(TPad* _toDrawInto) {
 
   // LINES
   for (unsigned int i = 0; i < lineX1.size(); ++i) {
-    TLine* _l = new TLine();
+    TLine* _l = own( new TLine() );
     _l->SetLineStyle( lineStyle.at(i) );
     _l->SetLineWidth( lineWidth.at(i) );
     if (plot2D != nullptr || true /*dark mode*/) _l->SetLineColor(0);
@@ -1336,71 +1383,290 @@ void nicePlot::debug() {
   }
 }
 
+// FNV-1a
+static void hashBytes(unsigned long long& _h, const void* _data, size_t _n) {
+  const unsigned char* _b = static_cast<const unsigned char*>(_data);
+  for (size_t _i = 0; _i < _n; ++_i) {
+    _h ^= _b[_i];
+    _h *= 1099511628211ULL;
+  }
+}
+
+template <class T> static void hashValue(unsigned long long& _h, const T& _v) {
+  hashBytes(_h, &_v, sizeof(T));
+}
+
+static void hashString(unsigned long long& _h, const TString& _s) {
+  hashValue(_h, _s.Length());
+  hashBytes(_h, _s.Data(), _s.Length());
+}
+
+template <class T> static void hashVector(unsigned long long& _h, const std::vector<T>& _v) {
+  hashValue(_h, _v.size());
+  for (const T& _e : _v) hashValue(_h, _e);
+}
+
+static void hashVector(unsigned long long& _h, const std::vector<TString>& _v) {
+  hashValue(_h, _v.size());
+  for (const TString& _e : _v) hashString(_h, _e);
+}
+
+template <class T> static void hashStyle(unsigned long long& _h, const T* _o) {
+  hashValue(_h, _o->GetLineColor());
+  hashValue(_h, _o->GetLineStyle());
+  hashValue(_h, _o->GetLineWidth());
+  hashValue(_h, _o->GetMarkerColor());
+  hashValue(_h, _o->GetMarkerStyle());
+  hashValue(_h, _o->GetMarkerSize());
+  hashValue(_h, _o->GetFillColor());
+  hashValue(_h, _o->GetFillStyle());
+  hashString(_h, _o->GetTitle());
+}
+
+static void hashGraph(unsigned long long& _h, const TGraphAsymmErrors* _g) {
+  const int _n = _g->GetN();
+  hashValue(_h, _n);
+  for (const double* _a : {_g->GetX(), _g->GetY(), _g->GetEXlow(), _g->GetEXhigh(), _g->GetEYlow(), _g->GetEYhigh()}) {
+    if (_a != nullptr) hashBytes(_h, _a, _n * sizeof(double));
+  }
+  hashStyle(_h, _g);
+}
+
+static void hashHist(unsigned long long& _h, const TH1* _hist) {
+  hashValue(_h, _hist->GetNcells());
+  for (int _bin = 0; _bin < _hist->GetNcells(); ++_bin) {
+    hashValue(_h, _hist->GetBinContent(_bin));
+    hashValue(_h, _hist->GetBinError(_bin));
+  }
+  hashStyle(_h, _hist);
+}
+
+unsigned long long nicePlot::contentHash() const {
+  unsigned long long _h = 14695981039346656037ULL;
+  hashValue(_h, kPlotHashVersion);
+  hashString(_h, xTitle);
+  hashString(_h, yTitle);
+  hashString(_h, rTitle);
+  hashString(_h, drawOp);
+  hashString(_h, stamp);
+  hashString(_h, colab);
+  hashString(_h, fit);
+  hashBytes(_h, mc_col, sizeof(mc_col));
+  hashBytes(_h, mc_sty, sizeof(mc_sty));
+  hashBytes(_h, data_col, sizeof(data_col));
+  hashBytes(_h, data_fill, sizeof(data_fill));
+  hashBytes(_h, data_sty, sizeof(data_sty));
+  for (const int _i : {n_mc, line_width, mc_marker_size, norm_command, norm_lower, norm_upper, rebin}) hashValue(_h, _i);
+  for (const double _d : {xMin, xMax, yMin, yMax, rMin, rMax, legendX, legendY, legendScale, titleOffsetMod,
+                          ySpaceModLin, ySpaceModLog, ratioLineValue, fitMin, fitMax}) hashValue(_h, _d);
+  for (const bool _b : {logX, logY, logZ, logR, norm_ndc, killLowStatBins, includeBothInRatioError, divideBinWidth,
+                        autoX, autoY, ratioOnly, doLegend, stretch, print_fit}) hashValue(_h, _b);
+  if (stamp != TString("NONE")) { hashValue(_h, stampX); hashValue(_h, stampY); }
+  for (const std::vector<TGraphAsymmErrors*>* _graphs : {&dataSyst, &dataStat, &mc, &ratio}) {
+    hashValue(_h, _graphs->size());
+    for (const TGraphAsymmErrors* _g : *_graphs) hashGraph(_h, _g);
+  }
+  hashVector(_h, ratioIsDataStyle);
+  hashVector(_h, mc_do);
+  hashVector(_h, bin_label_x);
+  hashVector(_h, bin_label_y);
+  hashVector(_h, plotText);
+  hashVector(_h, plotTextScale);
+  hashVector(_h, plotTextX);
+  hashVector(_h, plotTextY);
+  hashVector(_h, lineX1);
+  hashVector(_h, lineX2);
+  hashVector(_h, lineY1);
+  hashVector(_h, lineY2);
+  hashVector(_h, lineStyle);
+  hashVector(_h, lineWidth);
+  hashVector(_h, linePoint);
+  hashValue(_h, plot2D != nullptr);
+  if (plot2D != nullptr) hashHist(_h, plot2D);
+  hashValue(_h, mc_stack != nullptr);
+  if (mc_stack != nullptr) {
+    for (const auto&& obj : *mc_stack->GetHists()) hashHist(_h, (TH1*)obj);
+  }
+  return _h;
+}
+
+static unsigned long long readHash(const TString& _fname) {
+  unsigned long long _h = 0;
+  std::ifstream _in(_fname.Data());
+  _in >> std::hex >> _h;
+  return _h;
+}
+
+static void writeHash(const TString& _fname, const unsigned long long _h) {
+  std::ofstream _out(_fname.Data());
+  _out << std::hex << _h << std::endl;
+}
+
+static bool fileExists(const TString& _fname) {
+  return std::ifstream(_fname.Data()).good();
+}
+
 void bookOutput::doMultipadOutput(TString _name, int _x, int _y) {
   if (_x * _y != (int)(rp.size()/_break)) { err(TString("Invalid dimensions for doMultipadOutput. "+std::to_string(_x)+" * "+std::to_string(_y)+" != "+std::to_string(rp.size())+" / "+std::to_string(_break))); return; }
-  std::set<TCanvas*> _multiPads;
+  std::vector<bookPage> _pages;
   std::cout <<  "\033[1;32m Doing " << _name << " Book MultiPad Output " << std::endl;
 
   for (unsigned _i = 0; _i < _break; ++_i) {
-    TCanvas* _splitCanvas = new TCanvas();
-    gPad->SetMargin(0,0,0,0);
-    _splitCanvas->SetCanvasSize(_x*800 * (rp.at(0)->stretch ? 2.5 : 1), _y*600);
-    _splitCanvas->Divide(_x, _y, 0, 0);
     static int _count = 1;
-    for (unsigned _p = 0; _p < (unsigned)(_x*_y); ++_p) {
-      TPad* _pad = (TPad*) _splitCanvas->cd(_p+1);
-      _pad->SetFillColor(1); // WC MC
-      rp.at(_i + (_p * _break))->drawInto(_pad);
-    }
-    std::cout << "|" << std::flush;
-    TString _fname = _name + TString(".pdf");
-    if (_break > 1) {
-      if (_i == 0)             _fname += TString("(");
-      else if (_i == _break-1) _fname += TString(")");
-    }
-    unsigned old = gErrorIgnoreLevel;
-    TString _individualName = "img/" + _name + "_";
-    _individualName += _count++;
-    gErrorIgnoreLevel = 10000;
-    _splitCanvas->Print(_fname,"pdf");
-    _splitCanvas->Print(TString(_individualName + ".pdf"),"pdf");
-    _splitCanvas->Print(TString(_individualName + ".png"),"png");
-    gErrorIgnoreLevel = old;
-    _multiPads.insert(_splitCanvas);
+    bookPage _page;
+    _page.name = "img/" + _name + "_";
+    _page.name += _count++;
+    _page.hash = 14695981039346656037ULL;
+    hashValue(_page.hash, _x);
+    hashValue(_page.hash, _y);
+    for (unsigned _p = 0; _p < (unsigned)(_x*_y); ++_p) hashValue(_page.hash, rp.at(_i + (_p * _break))->contentHash());
+    _page.render = [_i, _x, _y]() {
+      TCanvas* _splitCanvas = new TCanvas();
+      multiPads.push_back(_splitCanvas);
+      gPad->SetMargin(0,0,0,0);
+      _splitCanvas->SetCanvasSize(_x*800 * (rp.at(0)->stretch ? 2.5 : 1), _y*600);
+      _splitCanvas->Divide(_x, _y, 0, 0);
+      for (unsigned _p = 0; _p < (unsigned)(_x*_y); ++_p) {
+        TPad* _pad = (TPad*) _splitCanvas->cd(_p+1);
+        _pad->SetFillColor(1); // WC MC
+        rp.at(_i + (_p * _break))->drawInto(_pad);
+      }
+      return _splitCanvas;
+    };
+    _pages.push_back(_page);
   }
+  renderPages(_pages, /*root*/false);
+  writeBook(_pages, _name);
   std::cout << "\033[0m\n";
 }
 
 void bookOutput::doBookOutput(TString _name) {
   unsigned max = _break;
+  std::vector<bookPage> _pages;
   std::cout <<  "\033[1;32m Doing " << _name << " Book Output " << std::endl;
   if (rp.size() < _break) max = rp.size();
   int _count = 1;
   for (unsigned i=0; i< max; ++i) {
-    std::cout << "|" << std::flush;
     // std::cout << rp.at(i)->xTitle << " "  << rp.at(i)->yTitle << std::endl;
-    TString fname = _name + TString(".pdf");
-    if (i == 0 && rp.size() > 1) {
-      fname += TString("(");
-      _count = 1;
-    }
-    else if (i == max-1 && rp.size() > 1) fname += TString(")");
-    TString _individualName = "img/" + _name + "_";
-    _individualName += _count++;
-    unsigned old = gErrorIgnoreLevel;
-    gErrorIgnoreLevel = 10000;
-    rp.at(i)->getCanvas()->Print(fname,"pdf");
-    rp.at(i)->getCanvas()->Print(TString(_individualName + ".png"),"png");
-    rp.at(i)->getCanvas()->Print(TString(_individualName + ".pdf"),"pdf");
-    rp.at(i)->getCanvas()->Print(TString(_individualName + ".root"),"root");
-    gErrorIgnoreLevel = old;
+    nicePlot* _np = rp.at(i);
+    bookPage _page;
+    _page.name = "img/" + _name + "_";
+    _page.name += _count++;
+    _page.hash = _np->contentHash();
+    _page.render = [_np]() { return _np->getCanvas(); };
+    _pages.push_back(_page);
   }
+  renderPages(_pages, /*root*/true);
+  writeBook(_pages, _name);
   std::cout << "\033[0m\n";
+  const std::vector<nicePlot*> _done(rp.begin(), rp.begin()+max);
   rp.erase(rp.begin(), rp.begin()+max);
+  for (nicePlot* _np : _done) delete _np;
+}
+
+// Render and export the pages whose inputs changed since their files were written. "|" is a rendered page, "." one that was up to date
+void bookOutput::renderPages(std::vector<bookPage>& _pages, bool _root) {
+  for (bookPage& _page : _pages) {
+    _page.upToDate = _incremental && readHash(_page.name + ".hash") == _page.hash;
+    if (_formats & kPagePNG) _page.upToDate &= fileExists(_page.name + ".png");
+    if (_formats & kPagePDF) _page.upToDate &= fileExists(_page.name + ".pdf");
+    if (_root && (_formats & kPageROOT)) _page.upToDate &= fileExists(_page.name + ".root");
+    if (!_page.upToDate) _page.canvas = _page.render();
+    std::cout << (_page.upToDate ? "." : "|") << std::flush;
+  }
+  if (!exportPages(_pages, _root)) return;
+  for (const bookPage& _page : _pages) {
+    if (!_page.upToDate) writeHash(_page.name + ".hash", _page.hash);
+  }
 }
 
+// When the per-page PDFs are written the book is assembled from them, so each page is rendered once and
+// unchanged pages not at all. Otherwise (or if that fails) the pages are printed into the book in order.
+void bookOutput::writeBook(std::vector<bookPage>& _pages, TString _name) {
+  if ((_formats & kBookPDF) == 0 || _pages.empty()) return;
+  unsigned long long _bookHash = 14695981039346656037ULL;
+  for (const bookPage& _page : _pages) hashValue(_bookHash, _page.hash);
+  if (_incremental && fileExists(_name + ".pdf") && readHash(_name + ".hash") == _bookHash) return;
+  if (_formats & kPagePDF) {
+    std::vector<std::string> _pagePDFs;
+    for (const bookPage& _page : _pages) _pagePDFs.push_back( std::string(_page.name.Data()) + ".pdf" );
+    if (mergePDFs(_pagePDFs, std::string(_name.Data()) + ".pdf")) {
+      writeHash(_name + ".hash", _bookHash);
+      return;
+    }
+    err("Cannot assemble " + _name + ".pdf from the page PDFs, printing it instead");
+  }
+  unsigned old = gErrorIgnoreLevel;
+  gErrorIgnoreLevel = 10000;
+  for (unsigned _i = 0; _i < _pages.size(); ++_i) {
+    TString _fname = _name + TString(".pdf");
+    if (_pages.size() > 1) {
+      if (_i == 0)                    _fname += TString("(");
+      else if (_i == _pages.size()-1) _fname += TString(")");
+    }
+    if (_pages.at(_i).canvas == nullptr) _pages.at(_i).canvas = _pages.at(_i).render();
+    _pages.at(_i).canvas->Print(_fname,"pdf");
+  }
+  gErrorIgnoreLevel = old;
+  writeHash(_name + ".hash", _bookHash);
+}
+
+// The per-page files are independent so they are split over forked workers.
+// Only in batch mode, a forked child must not share a connection to the display.
+bool bookOutput::exportPages(const std::vector<bookPage>& _pages, bool _root) {
+  std::vector<unsigned> _todo;
+  for (unsigned _i = 0; _i < _pages.size(); ++_i) if (!_pages.at(_i).upToDate) _todo.push_back(_i);
+  if ((_formats & (kPagePNG | kPagePDF | (_root ? kPageROOT : 0))) == 0 || _todo.empty()) return true;
+  unsigned old = gErrorIgnoreLevel;
+  gErrorIgnoreLevel = 10000;
+  auto _export = [&](unsigned _i) {
+    TCanvas* _c = _pages.at(_i).canvas;
+    const TString& _individualName = _pages.at(_i).name;
+    if (_formats & kPagePNG) _c->Print(TString(_individualName + ".png"),"png");
+    if (_formats & kPagePDF) _c->Print(TString(_individualName + ".pdf"),"pdf");
+    if (_root && (_formats & kPageROOT)) _c->Print(TString(_individualName + ".root"),"root");
+  };
+  bool _ok = true;
+  unsigned _nWorkers = (_workers ? _workers : (unsigned) sysconf(_SC_NPROCESSORS_ONLN));
+  if (_nWorkers > _todo.size()) _nWorkers = _todo.size();
+  if (!gROOT->IsBatch()) _nWorkers = 1;
+  if (_nWorkers <= 1) {
+    for (const unsigned _i : _todo) _export(_i);
+  } else {
+    std::vector<pid_t> _children;
+    std::cout << std::flush;
+    for (unsigned _w = 0; _w < _nWorkers; ++_w) {
+      const pid_t _pid = fork();
+      if (_pid == 0) {
+        for (unsigned _t = _w; _t < _todo.size(); _t += _nWorkers) _export(_todo.at(_t));
+        _exit(0);
+      } else if (_pid < 0) {
+        err("Cannot fork page export worker, exporting in this process");
+        for (unsigned _t = _w; _t < _todo.size(); _t += _nWorkers) _export(_todo.at(_t));
+      } else {
+        _children.push_back(_pid);
+      }
+    }
+    for (const pid_t _pid : _children) {
+      int _status = 0;
+      waitpid(_pid, &_status, 0);
+      if (!WIFEXITED(_status) || WEXITSTATUS(_status) != 0) {
+        err("Page export worker failed");
+        _ok = false;
+      }
+    }
+  }
+  gErrorIgnoreLevel = old;
+  return _ok;
+}
+
+// Plots go before the multipad canvases they were drawn into
 void bookOutput::clear() {
-  rp.erase(rp.begin(), rp.end());
+  const std::vector<nicePlot*> _done(rp);
+  rp.clear();
+  for (nicePlot* _np : _done) delete _np;
+  for (TCanvas* _c : multiPads) delete _c;
+  multiPads.clear();
 }
 
 bookOutput& bookOutput::get() {
@@ -1412,6 +1678,18 @@ void bookOutput::setBreak(int _b) {
   _break = _b;
 }
 
+void bookOutput::setFormats(unsigned _f) {
+  _formats = _f;
+}
+
+void bookOutput::setWorkers(unsigned _w) {
+  _workers = _w;
+}
+
+void bookOutput::setIncremental(bool _i) {
+  _incremental = _i;
+}
+
 void bookOutput::setBreakNow() {
   if (_break == 9999) _break = rp.size();
 }
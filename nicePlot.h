@@ -17,6 +17,7 @@
 #include <TArrow.h>
 #include <THStack.h>
 #include <iostream>
+#include <functional>
 #include <TStyle.h>
 #include <TSystem.h>
 #include <TLine.h>
@@ -26,8 +27,18 @@ enum nicePlotArrow_t{kNPArrowNone, kNPArrowRight, kNPArrowLeft, kNPArrowUp, kNPA
 
 enum ObjType_t{kObjTypeGraph, kObjTypeTH1, kObjTypeTH2, kUnsuportedType};
 
+enum bookFormat_t{kBookPDF = 1, kPagePNG = 2, kPagePDF = 4, kPageROOT = 8, kAllFormats = 15, kDefaultFormats = 7};
+
 class nicePlot;
 
+struct bookPage {
+  TString name; // img/NAME_i, without the extension
+  std::function<TCanvas*()> render;
+  TCanvas* canvas = nullptr; // Only set once rendered
+  unsigned long long hash = 0; // Of everything that goes into the page
+  bool upToDate = false; // Files on disk were made from the same hash
+};
+
 void addDivider(TString _text1, TString _text2);
 
 class bookOutput {
@@ -41,16 +52,34 @@ public:
   static void book(nicePlot* _rp);
   static void unbook(nicePlot* _rp);
   static void clear();
+  static void setFormats(unsigned _f); // Mask of bookFormat_t
+  static void setWorkers(unsigned _w); // Processes for the per-page exports, 0 for one per core
+  static void setIncremental(bool _i); // Skip pages whose files were made from the same inputs
 
 private:
-  static std::vector<nicePlot*> rp;
+  static void renderPages(std::vector<bookPage>& _pages, bool _root);
+  static bool exportPages(const std::vector<bookPage>& _pages, bool _root);
+  static void writeBook(std::vector<bookPage>& _pages, TString _name);
+
+  static std::vector<nicePlot*> rp; // Owned, deleted once output
+  static std::vector<TCanvas*> multiPads; // Owned, deleted by clear()
   static unsigned _break;
+  static unsigned _formats;
+  static unsigned _workers;
+  static bool _incremental;
 
   bookOutput() {};
   bookOutput(bookOutput const&);
   void operator=(bookOutput const&);
 };
 
+// Colours and palettes are created once per process and shared by every plot
+class nicePalette {
+public:
+  static void registerColours(); // The alt. colour scheme, indices 2556 to 2562
+  static void useCool(); // Select the kCool gradient for 2D plots
+};
+
 
 class nicePlot {
 public:
@@ -59,6 +88,7 @@ public:
   nicePlot(TString _xTitle, TString _yTitle, TString _rTitle = "");
   nicePlot(nicePlot& _copy);
   nicePlot(nicePlot* _copy);
+  ~nicePlot();
   void reset();
   void init(TString _xTitle, TString _yTitle, TString _rTitle = "", bool quiet = false);
   void book();
@@ -132,6 +162,7 @@ public:
   void setRatioOnly(bool _r) { ratioOnly = _r; }
   void setIncludeBothInRatioError(bool _i) { includeBothInRatioError = _i; }
   void debug();
+  unsigned long long contentHash() const; // Of the inputs and style, not of what getCanvas derives from them
   void setKillLowStatBins(bool _k = true) { killLowStatBins = _k; }
   void setLineWidth(int lw) { line_width = lw; }
   void setMCMarkerSize(int s) { mc_marker_size = s; }
@@ -145,6 +176,12 @@ public:
   TH1* _frame_top;
   TH1* _frame_bot;
 
+  // Everything the plot allocates is owned by it and deleted with it. Copies share the source's graphs,
+  // so the source must outlive them. Graphs passed in by pointer stay with the caller.
+  template <class T> T* own(T* _o) { owned.push_back(_o); return _o; }
+  template <class T> T* ownPad(T* _p) { ownedPads.push_back(_p); return _p; }
+  void release();
+
   //private:
 
 
@@ -192,6 +229,9 @@ public:
   TProfile _aProfile;
   TCanvas* c;
   THStack* mc_stack = nullptr;
+  THStack* ownedStack = nullptr;
+  std::vector<TObject*> owned;
+  std::vector<TPad*> ownedPads; // Canvas and pads, deleted after what was drawn in them
 
   std::vector<TString> plotText;
   std::vector<double> plotTextScale;
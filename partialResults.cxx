@@ -0,0 +1,212 @@
+#include "partialResults.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+static const char kPartialMagic[8] = {'W', 'C', 'M', 'C', 'P', 'A', 'R', 'T'};
+static const uint64_t kPartialMaxLength = 1 << 24; // Sanity limit on strings and arrays read back
+
+bool partialFile::openWrite(const std::string& fname, partialHeader& header) {
+  close();
+  m_file = fopen(fname.c_str(), "wb");
+  if (m_file == nullptr) {
+    std::cout << "Error. Cannot open partial results " << fname << " for writing" << std::endl;
+    return false;
+  }
+  m_ok = true;
+  memcpy(header.magic, kPartialMagic, sizeof(kPartialMagic));
+  header.version = kPartialVersion;
+  put(header);
+  return m_ok;
+}
+
+bool partialFile::openRead(const std::string& fname, partialHeader& header) {
+  close();
+  m_file = fopen(fname.c_str(), "rb");
+  if (m_file == nullptr) {
+    std::cout << "Error. Cannot open partial results " << fname << std::endl;
+    return false;
+  }
+  m_ok = true;
+  get(header);
+  if (!m_ok || memcmp(header.magic, kPartialMagic, sizeof(kPartialMagic)) != 0 || header.version != kPartialVersion) {
+    std::cout << "Error. " << fname << " is not a partial results file" << std::endl;
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool partialFile::close() {
+  if (m_file != nullptr && fclose(m_file) != 0) m_ok = false;
+  m_file = nullptr;
+  return m_ok;
+}
+
+void partialFile::write(const void* data, const size_t bytes) {
+  if (m_ok && fwrite(data, 1, bytes, m_file) != bytes) m_ok = false;
+}
+
+void partialFile::read(void* data, const size_t bytes) {
+  if (m_ok && fread(data, 1, bytes, m_file) != bytes) m_ok = false;
+}
+
+void partialFile::put(const std::string& s) {
+  put((uint64_t) s.size());
+  write(s.data(), s.size());
+}
+
+void partialFile::put(const std::vector<double>& v) {
+  put((uint64_t) v.size());
+  write(v.data(), v.size() * sizeof(double));
+}
+
+void partialFile::get(std::string& s) {
+  uint64_t n = 0;
+  get(n);
+  if (n > kPartialMaxLength) m_ok = false;
+  s.assign(m_ok ? n : 0, ' ');
+  read(&s[0], s.size());
+}
+
+void partialFile::get(std::vector<double>& v) {
+  uint64_t n = 0;
+  get(n);
+  if (n > kPartialMaxLength) m_ok = false;
+  v.assign(m_ok ? n : 0, 0.);
+  read(v.data(), v.size() * sizeof(double));
+}
+
+namespace {
+  // The counts behind every histogram of the results, by name
+  std::map<std::string, const binCounts*> partialHistograms(const tournamentConfig& config, const simulationResults& results) {
+    std::map<std::string, const binCounts*> hists;
+    hists["GoalsMC"] = &results.goals;
+    hists["GoalDiffMC"] = &results.goalDiff;
+    for (int i = 0; i < 6; ++i) hists["roundWinner/" + std::to_string(i)] = &results.stages[i];
+    for (int g = 0; g < config.nGroups(); ++g) {
+      for (int position = 0; position < kTeamsPerGroup; ++position) {
+        hists["roundWinner/" + config.groupLetter(g) + std::to_string(position)] = &results.groupPositions[g * kTeamsPerGroup + position];
+      }
+    }
+    for (int a = 0; a < config.nTeams(); ++a) {
+      for (int b = 0; b < config.nTeams(); ++b) {
+        if (results.played(a, b)) hists["matchResult/" + config.team(a).name + "_" + config.team(b).name] = &results.scores[a * results.nTeams + b];
+      }
+    }
+    return hists;
+  }
+
+  binCounts* partialCounts(const std::string& name, const tournamentConfig& config, simulationResults& results) {
+    if (name == "GoalsMC") return &results.goals;
+    if (name == "GoalDiffMC") return &results.goalDiff;
+    if (name.compare(0, 12, "matchResult/") == 0) {
+      const size_t split = name.find('_', 12);
+      if (split == std::string::npos) return nullptr;
+      const int a = config.teamIndex(name.substr(12, split - 12)), b = config.teamIndex(name.substr(split + 1));
+      return (a < 0 || b < 0 ? nullptr : &results.score(a, b));
+    }
+    if (name.compare(0, 12, "roundWinner/") != 0 || name.size() < 13) return nullptr;
+    const std::string key = name.substr(12);
+    if (key.size() == 1 && key[0] >= '0' && key[0] <= '5') return &results.stages[key[0] - '0'];
+    const int group = config.groupIndex(key.substr(0, key.size() - 1)), position = key.back() - '0';
+    if (group < 0 || position < 0 || position >= kTeamsPerGroup) return nullptr;
+    return &results.groupPositions[group * kTeamsPerGroup + position];
+  }
+}
+
+bool writePartial(const std::string& fname, partialHeader& header, const tournamentConfig& config, const simulationResults& results) {
+  partialFile f;
+  if (!f.openWrite(fname, header)) return false;
+  const std::map<std::string, const binCounts*> hists = partialHistograms(config, results);
+  f.put((uint64_t) hists.size());
+  for (const auto& [name, h] : hists) {
+    std::vector<double> content(h->cells()), sumw2;
+    for (int i = 0; i < h->cells(); ++i) content[i] = h->count(i);
+    if (h->weighted()) for (int i = 0; i < h->cells(); ++i) sumw2.push_back(h->sumw2(i));
+    f.put(name);
+    f.put(content);
+    f.put(sumw2);
+    f.put((double) h->entries());
+  }
+  for (const std::map<std::string, uint64_t>* outcomes : {&results.outcomesToSemi, &results.outcomesToQuarter, &results.outcomes}) {
+    f.put((uint64_t) outcomes->size());
+    for (const auto& [key, n] : *outcomes) {
+      f.put(key);
+      f.put((uint64_t) n);
+    }
+  }
+  if (!f.close()) {
+    std::cout << "Error. Failed writing partial results " << fname << std::endl;
+    return false;
+  }
+  std::cout << "Wrote trials [" << header.first << ", " << header.last << ") of " << header.totalTrials << " to " << fname << std::endl;
+  return true;
+}
+
+bool mergePartials(const std::vector<std::string>& files, const tournamentConfig& config, simulationResults& results, partialHeader& header) {
+  results.reset();
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+  uint64_t totalTrials = 0;
+  for (const std::string& fname : files) {
+    partialFile f;
+    if (!f.openRead(fname, header)) return false;
+    if (header.mode != (uint32_t)config.mode() || header.year != (uint32_t)config.year() || (ranges.size() && header.totalTrials != totalTrials)) {
+      std::cout << "Error. " << fname << " is from a different campaign (mode " << header.mode << ", year " << header.year << ", " << header.totalTrials << " trials)" << std::endl;
+      return false;
+    }
+    totalTrials = header.totalTrials;
+    ranges.push_back(std::make_pair(header.first, header.last));
+
+    uint64_t nHists = 0;
+    f.get(nHists);
+    for (uint64_t n = 0; n < nHists && f.ok(); ++n) {
+      std::string name;
+      std::vector<double> content, sumw2;
+      double entries = 0;
+      f.get(name);
+      f.get(content);
+      f.get(sumw2);
+      f.get(entries);
+      binCounts* counts = partialCounts(name, config, results);
+      if (counts == nullptr || !counts->add(content, sumw2, entries)) {
+        std::cout << "Error. Histogram " << name << " in " << fname << " does not match this configuration" << std::endl;
+        return false;
+      }
+    }
+    for (std::map<std::string, uint64_t>* outcomes : {&results.outcomesToSemi, &results.outcomesToQuarter, &results.outcomes}) {
+      uint64_t nOutcomes = 0;
+      f.get(nOutcomes);
+      for (uint64_t n = 0; n < nOutcomes && f.ok(); ++n) {
+        std::string key;
+        uint64_t count = 0;
+        f.get(key);
+        f.get(count);
+        (*outcomes)[key] += count;
+      }
+    }
+    if (!f.close()) {
+      std::cout << "Error. Failed reading partial results " << fname << std::endl;
+      return false;
+    }
+  }
+
+  std::sort(ranges.begin(), ranges.end());
+  uint64_t next = 0;
+  for (const auto& [first, last] : ranges) {
+    if (first != next) {
+      std::cout << "Error. Partial results do not cover trials " << next << " to " << first << " exactly once" << std::endl;
+      return false;
+    }
+    next = last;
+  }
+  if (next != totalTrials) {
+    std::cout << "Error. Partial results stop at trial " << next << " of " << totalTrials << std::endl;
+    return false;
+  }
+  results.trials = totalTrials;
+  std::cout << "Merged " << files.size() << " partial results, " << totalTrials << " trials" << std::endl;
+  return true;
+}
@@ -0,0 +1,64 @@
+#ifndef WCMC_PARTIALRESULTS_H
+#define WCMC_PARTIALRESULTS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "wcEngine.h"
+
+// Binary partial results of one shard of runFinal, combined by --merge.
+// A header, then the histograms (name, per-cell contents, per-cell sumw2 if any, entries), then the three outcome counters.
+
+const uint32_t kPartialVersion = 1;
+
+struct partialHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t mode;
+  uint32_t year;
+  uint32_t shard;
+  uint32_t shards;
+  uint64_t first; // This shard ran trials [first, last) of totalTrials
+  uint64_t last;
+  uint64_t totalTrials;
+  float goalinessLow;
+  float goalinessHigh;
+  float chiG_Training;
+  float chiGD_Training;
+};
+
+class partialFile {
+public:
+  partialFile() : m_file(nullptr), m_ok(false) {}
+  ~partialFile() { close(); }
+
+  bool openWrite(const std::string& fname, partialHeader& header);
+  bool openRead(const std::string& fname, partialHeader& header);
+  bool close(); // False if any read or write failed
+  bool ok() const { return m_ok; }
+
+  template <typename T> void put(const T& value) { write(&value, sizeof(T)); }
+  void put(const std::string& s);
+  void put(const std::vector<double>& v);
+
+  template <typename T> void get(T& value) { read(&value, sizeof(T)); }
+  void get(std::string& s);
+  void get(std::vector<double>& v);
+
+private:
+  void write(const void* data, const size_t bytes);
+  void read(void* data, const size_t bytes);
+
+  FILE* m_file;
+  bool m_ok;
+};
+
+// Histograms are named as in the ROOT output: GoalsMC, GoalDiffMC, roundWinner/<stage or group position>, matchResult/<teamA>_<teamB>.
+// header gives the campaign and this shard's trials, its magic and version are filled in
+bool writePartial(const std::string& fname, partialHeader& header, const tournamentConfig& config, const simulationResults& results);
+// Adds the files into results, which must be initialised for the config. They must cover the campaign's trials exactly once.
+// header is left as that of the last file
+bool mergePartials(const std::vector<std::string>& files, const tournamentConfig& config, simulationResults& results, partialHeader& header);
+
+#endif // WCMC_PARTIALRESULTS_H
@@ -0,0 +1,352 @@
+#include "pdfMerge.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+
+namespace {
+
+const char* kInheritable[] = {"/Resources", "/MediaBox", "/CropBox", "/Rotate"}; // Page attributes a /Pages node can hold
+
+struct pdfObject {
+  std::string value; // Everything between "obj" and "stream" or "endobj"
+  std::string stream; // Raw stream bytes, if any
+  bool hasStream = false;
+};
+
+struct pdfInput {
+  std::string fname;
+  std::string data;
+  std::map<int, size_t> offsets; // From the xref table
+  std::map<int, pdfObject> objects; // Parsed on demand
+  std::string trailer;
+};
+
+bool isDelimiter(const char c) {
+  return std::isspace((unsigned char)c) || std::strchr("()<>[]{}/%", c) != nullptr;
+}
+
+size_t skipSpace(const std::string& s, size_t p) {
+  while (p < s.size()) {
+    if (std::isspace((unsigned char)s[p])) ++p;
+    else if (s[p] == '%') { while (p < s.size() && s[p] != '\n' && s[p] != '\r') ++p; }
+    else break;
+  }
+  return p;
+}
+
+// End of the literal string starting at the '(' at p, honouring escapes and nesting
+size_t stringEnd(const std::string& s, size_t p) {
+  int depth = 0;
+  for (; p < s.size(); ++p) {
+    if (s[p] == '\\') ++p;
+    else if (s[p] == '(') ++depth;
+    else if (s[p] == ')' && --depth == 0) return p + 1;
+  }
+  return std::string::npos;
+}
+
+// End of the single value (dict, array, string, name, number, keyword or "N G R" reference) starting at p
+size_t valueEnd(const std::string& s, size_t p) {
+  p = skipSpace(s, p);
+  if (p >= s.size()) return std::string::npos;
+  if (s.compare(p, 2, "<<") == 0 || s[p] == '[') {
+    const bool dict = (s[p] == '<');
+    p += (dict ? 2 : 1);
+    while (true) {
+      p = skipSpace(s, p);
+      if (p >= s.size()) return std::string::npos;
+      if (dict && s.compare(p, 2, ">>") == 0) return p + 2;
+      if (!dict && s[p] == ']') return p + 1;
+      p = valueEnd(s, p);
+      if (p == std::string::npos) return p;
+    }
+  }
+  if (s[p] == '(') return stringEnd(s, p);
+  if (s[p] == '<') {
+    const size_t close = s.find('>', p);
+    return (close == std::string::npos ? close : close + 1);
+  }
+  const size_t start = p;
+  if (s[p] == '/') ++p;
+  while (p < s.size() && !isDelimiter(s[p])) ++p;
+  if (p == start) return std::string::npos;
+  if (std::isdigit((unsigned char)s[start])) { // Maybe the object number of a reference
+    size_t q = skipSpace(s, p), g = q;
+    while (q < s.size() && std::isdigit((unsigned char)s[q])) ++q;
+    if (q > g) {
+      q = skipSpace(s, q);
+      if (q < s.size() && s[q] == 'R' && (q + 1 == s.size() || isDelimiter(s[q + 1]))) return q + 1;
+    }
+  }
+  return p;
+}
+
+// Top level entries of a dictionary, key -> value text
+bool dictEntries(const std::string& s, std::vector< std::pair<std::string, std::string> >& entries) {
+  size_t p = skipSpace(s, 0);
+  if (s.compare(p, 2, "<<") != 0) return false;
+  p += 2;
+  while (true) {
+    p = skipSpace(s, p);
+    if (p >= s.size() || s[p] != '/') return s.compare(p, 2, ">>") == 0;
+    const size_t keyEnd = valueEnd(s, p);
+    const size_t end = valueEnd(s, keyEnd);
+    if (keyEnd == std::string::npos || end == std::string::npos) return false;
+    const size_t start = skipSpace(s, keyEnd);
+    entries.push_back( std::make_pair(s.substr(p, keyEnd - p), s.substr(start, end - start)) );
+    p = end;
+  }
+}
+
+std::string dictValue(const std::string& s, const std::string& key) {
+  std::vector< std::pair<std::string, std::string> > entries;
+  dictEntries(s, entries);
+  for (const auto& entry : entries) if (entry.first == key) return entry.second;
+  return "";
+}
+
+// Calls onRef for each "N G R" outside strings, which returns the replacement text
+std::string mapRefs(const std::string& s, const std::function<std::string(int)>& onRef) {
+  std::string out;
+  size_t p = 0;
+  while (p < s.size()) {
+    if (s[p] == '<' && s.compare(p, 2, "<<") != 0) { // Hex string
+      const size_t end = std::min(s.find('>', p), s.size() - 1) + 1;
+      out += s.substr(p, end - p);
+      p = end;
+    } else if (s.compare(p, 2, "<<") == 0) {
+      out += "<<";
+      p += 2;
+    } else if (s[p] == '(') {
+      const size_t end = stringEnd(s, p);
+      if (end == std::string::npos) { out += s.substr(p); break; }
+      out += s.substr(p, end - p);
+      p = end;
+    } else if (std::isdigit((unsigned char)s[p]) && (p == 0 || isDelimiter(s[p - 1]))) {
+      const size_t end = valueEnd(s, p);
+      if (end != std::string::npos && s[end - 1] == 'R') out += onRef(std::stoi(s.substr(p)));
+      else out += s.substr(p, end - p);
+      p = end;
+    } else {
+      out += s[p++];
+    }
+  }
+  return out;
+}
+
+bool parseRef(const std::string& value, int& num) {
+  if (value.empty() || value.back() != 'R' || !std::isdigit((unsigned char)value[0])) return false;
+  num = std::stoi(value);
+  return true;
+}
+
+bool readXref(pdfInput& in) {
+  const size_t startxref = in.data.rfind("startxref");
+  if (startxref == std::string::npos) return false;
+  size_t p = strtoul(in.data.c_str() + skipSpace(in.data, startxref + 9), nullptr, 10);
+  if (p >= in.data.size()) return false;
+  if (in.data.compare(p, 4, "xref") != 0) return false; // Cross-reference streams are not supported
+  p += 4;
+  while (true) {
+    p = skipSpace(in.data, p);
+    if (in.data.compare(p, 7, "trailer") == 0) break;
+    int first = 0, count = 0, consumed = 0;
+    if (sscanf(in.data.c_str() + p, "%d %d%n", &first, &count, &consumed) != 2) return false;
+    p += consumed;
+    for (int i = 0; i < count; ++i) {
+      unsigned long offset = 0;
+      int gen = 0;
+      char type = 0;
+      if (sscanf(in.data.c_str() + p, " %lu %d %c%n", &offset, &gen, &type, &consumed) != 3) return false;
+      p += consumed;
+      if (type == 'n') in.offsets[first + i] = offset;
+    }
+  }
+  p = skipSpace(in.data, p + 7);
+  const size_t end = valueEnd(in.data, p);
+  if (end == std::string::npos) return false;
+  in.trailer = in.data.substr(p, end - p);
+  return dictValue(in.trailer, "/Prev").empty(); // No incremental updates
+}
+
+const pdfObject* getObject(pdfInput& in, const int num) {
+  std::map<int, pdfObject>::const_iterator cached = in.objects.find(num);
+  if (cached != in.objects.end()) return &cached->second;
+  std::map<int, size_t>::const_iterator offset = in.offsets.find(num);
+  if (offset == in.offsets.end()) return nullptr;
+  const std::string& s = in.data;
+  size_t p = s.find("obj", offset->second);
+  if (p == std::string::npos) return nullptr;
+  p += 3;
+  const size_t end = valueEnd(s, p);
+  if (end == std::string::npos) return nullptr;
+  pdfObject obj;
+  obj.value = s.substr(skipSpace(s, p), end - skipSpace(s, p));
+  size_t q = skipSpace(s, end);
+  if (s.compare(q, 6, "stream") == 0) {
+    q += 6;
+    if (s.compare(q, 2, "\r\n") == 0) q += 2;
+    else if (q < s.size() && s[q] == '\n') ++q;
+    else return nullptr;
+    const std::string lengthValue = dictValue(obj.value, "/Length");
+    int lengthRef = 0;
+    size_t length = 0;
+    if (parseRef(lengthValue, lengthRef)) {
+      in.objects[num] = pdfObject(); // Guard against a length referring back to this object
+      const pdfObject* lengthObj = getObject(in, lengthRef);
+      in.objects.erase(num);
+      if (lengthObj == nullptr || lengthObj->hasStream) return nullptr;
+      length = strtoul(lengthObj->value.c_str(), nullptr, 10);
+    } else if (!lengthValue.empty()) {
+      length = strtoul(lengthValue.c_str(), nullptr, 10);
+    } else return nullptr;
+    if (q + length > s.size() || s.compare(skipSpace(s, q + length), 9, "endstream") != 0) return nullptr;
+    obj.stream = s.substr(q, length);
+    obj.hasStream = true;
+  }
+  return &(in.objects[num] = obj);
+}
+
+struct pageRef {
+  int num;
+  std::map<std::string, std::string> inherited;
+};
+
+bool collectPages(pdfInput& in, const int num, std::map<std::string, std::string> inherited, std::vector<pageRef>& pages, int depth) {
+  const pdfObject* node = getObject(in, num);
+  if (node == nullptr || depth > 32) return false;
+  const std::string type = dictValue(node->value, "/Type");
+  if (type == "/Page") {
+    pages.push_back({num, inherited});
+    return true;
+  }
+  if (type != "/Pages") return false;
+  for (const char* key : kInheritable) {
+    const std::string value = dictValue(node->value, key);
+    if (!value.empty()) inherited[key] = value;
+  }
+  const std::string kids = dictValue(node->value, "/Kids");
+  if (kids.empty() || kids[0] != '[') return false;
+  bool ok = true;
+  mapRefs(kids, [&](int kid) { ok = ok && collectPages(in, kid, inherited, pages, depth + 1); return std::string(); });
+  return ok;
+}
+
+} // namespace
+
+bool mergePDFs(const std::vector<std::string>& inputs, const std::string& output) {
+  const int kCatalog = 1, kPages = 2;
+  std::string version = "1.4";
+  std::vector<std::string> bodies(kPages + 1); // Indexed by new object number
+  std::vector<int> newPages;
+
+  for (const std::string& fname : inputs) {
+    pdfInput in;
+    in.fname = fname;
+    std::ifstream file(fname, std::ios::binary);
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    in.data = buffer.str();
+    if (!file || in.data.compare(0, 5, "%PDF-") != 0 || !readXref(in)) {
+      std::cout << "Error. Cannot read " << fname << " as a PDF to merge" << std::endl;
+      return false;
+    }
+    version = std::max(version, in.data.substr(5, 3));
+
+    int root = 0, pagesRoot = 0;
+    const pdfObject* catalog = (parseRef(dictValue(in.trailer, "/Root"), root) ? getObject(in, root) : nullptr);
+    std::vector<pageRef> pages;
+    if (catalog == nullptr || !parseRef(dictValue(catalog->value, "/Pages"), pagesRoot) || !collectPages(in, pagesRoot, {}, pages, 0)) {
+      std::cout << "Error. Cannot find the pages of " << fname << std::endl;
+      return false;
+    }
+
+    // Renumber everything reachable from the pages, the page tree itself collapses into the single new /Pages
+    std::map<int, int> renumber;
+    std::set<int> pageNodes;
+    for (const pageRef& page : pages) pageNodes.insert(page.num);
+    std::vector<int> queue;
+    bool ok = true;
+    const std::function<std::string(int)> onRef = [&](int num) {
+      const pdfObject* obj = getObject(in, num);
+      if (obj == nullptr) { ok = false; return std::string("null"); }
+      const std::string type = (obj->hasStream ? "" : dictValue(obj->value, "/Type"));
+      if (type == "/Catalog" || type == "/Pages") return std::to_string(type == "/Catalog" ? kCatalog : kPages) + " 0 R";
+      if (type == "/Page" && !pageNodes.count(num)) { ok = false; return std::string("null"); } // Link to a page we do not have
+      if (!renumber.count(num)) {
+        renumber[num] = bodies.size();
+        bodies.push_back("");
+        queue.push_back(num);
+      }
+      return std::to_string(renumber[num]) + " 0 R";
+    };
+    for (const pageRef& page : pages) {
+      onRef(page.num);
+      newPages.push_back(renumber[page.num]);
+    }
+    for (size_t i = 0; i < queue.size() && ok; ++i) {
+      const int num = queue[i];
+      const pdfObject* obj = getObject(in, num);
+      std::string value = obj->value;
+      if (pageNodes.count(num)) { // Point at the new parent and take what it used to inherit
+        std::vector< std::pair<std::string, std::string> > entries;
+        dictEntries(value, entries);
+        value = "<<";
+        std::map<std::string, std::string> inherited;
+        for (const pageRef& page : pages) if (page.num == num) inherited = page.inherited;
+        for (const auto& entry : entries) {
+          inherited.erase(entry.first);
+          if (entry.first != "/Parent") value += " " + entry.first + " " + entry.second;
+        }
+        for (const auto& entry : inherited) value += " " + entry.first + " " + entry.second;
+        value += " >>";
+      }
+      std::string body = mapRefs(value, onRef);
+      if (pageNodes.count(num)) body.insert(2, " /Parent " + std::to_string(kPages) + " 0 R"); // Added after renumbering so it is not taken as an old object number
+      if (obj->hasStream) body += "\nstream\n" + obj->stream + "\nendstream";
+      bodies[renumber[num]] = body;
+    }
+    if (!ok) {
+      std::cout << "Error. Broken reference in " << fname << std::endl;
+      return false;
+    }
+  }
+
+  std::string kids;
+  for (const int page : newPages) kids += std::to_string(page) + " 0 R ";
+  bodies[kCatalog] = "<< /Type /Catalog /Pages " + std::to_string(kPages) + " 0 R >>";
+  bodies[kPages] = "<< /Type /Pages /Kids [ " + kids + "] /Count " + std::to_string(newPages.size()) + " >>";
+
+  std::string out = "%PDF-" + version + "\n%\xE2\xE3\xCF\xD3\n";
+  std::vector<size_t> offsets(bodies.size(), 0);
+  for (size_t num = 1; num < bodies.size(); ++num) {
+    offsets[num] = out.size();
+    out += std::to_string(num) + " 0 obj\n" + bodies[num] + "\nendobj\n";
+  }
+  const size_t xref = out.size();
+  out += "xref\n0 " + std::to_string(bodies.size()) + "\n0000000000 65535 f \n";
+  char entry[32];
+  for (size_t num = 1; num < bodies.size(); ++num) {
+    snprintf(entry, sizeof(entry), "%010zu 00000 n \n", offsets[num]);
+    out += entry;
+  }
+  out += "trailer\n<< /Size " + std::to_string(bodies.size()) + " /Root " + std::to_string(kCatalog) + " 0 R >>\nstartxref\n" + std::to_string(xref) + "\n%%EOF\n";
+
+  std::ofstream file(output, std::ios::binary);
+  file.write(out.data(), out.size());
+  file.close();
+  if (!file) {
+    std::cout << "Error. Cannot write " << output << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,12 @@
+#ifndef WCMC_PDFMERGE_H
+#define WCMC_PDFMERGE_H
+
+#include <string>
+#include <vector>
+
+// Concatenates the pages of PDFs, as written by TPDF, into one file without rendering them again.
+// The objects reachable from each page are copied and renumbered, anything else (outlines, info) is dropped.
+// Only classic xref tables are understood. Returns false, without writing the output, for anything else.
+bool mergePDFs(const std::vector<std::string>& inputs, const std::string& output);
+
+#endif // WCMC_PDFMERGE_H
@@ -0,0 +1,19 @@
+#include "profile.h"
+
+#ifdef WCMC_PROFILE
+
+#include <cstdlib>
+#include <new>
+
+// Replaced globally to count allocations, noinline keeps GCC from pairing malloc/free against new/delete
+__attribute__((noinline)) void* operator new(size_t size) {
+  g_profileAllocations.fetch_add(1, std::memory_order_relaxed);
+  g_profileAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  void* p = std::malloc(size ? size : 1);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+#endif // WCMC_PROFILE
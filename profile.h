@@ -0,0 +1,130 @@
+#ifndef WCMC_PROFILE_H
+#define WCMC_PROFILE_H
+
+// Phase timers and counters. Compiled in with -DWCMC_PROFILE, otherwise every macro compiles to nothing.
+//   PROFILE_SCOPE("name")      Time from here to the end of the scope (inclusive of nested scopes), and count allocations
+//   PROFILE_COUNT("name", n)   Add n to a counter, the summary also shows the mean per call
+//   PROFILE_MAX("name", n)     Track the largest value seen, e.g. a container size
+//   PROFILE_SUMMARY()          Print the table
+// Each call site looks its entry up once, so the cost per use is a clock read or an add.
+// Entries are shared by every thread and updated atomically: timers add up the time spent on all threads, and a scope's
+// allocations include those other threads made meanwhile.
+
+#ifdef WCMC_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct profileEntry {
+  profileEntry(const std::string& n, const bool t) : name(n), timer(t), calls(0), total(0), max(0), allocations(0) {}
+  void add(const double n) { // One call adding n
+    calls.fetch_add(1, std::memory_order_relaxed);
+    double old = total.load(std::memory_order_relaxed);
+    while (!total.compare_exchange_weak(old, old + n, std::memory_order_relaxed)) {}
+    setMax(n);
+  }
+  void set(const double n) { // One call of value n
+    calls.fetch_add(1, std::memory_order_relaxed);
+    total.store(n, std::memory_order_relaxed);
+    setMax(n);
+  }
+  void setMax(const double n) {
+    double old = max.load(std::memory_order_relaxed);
+    while (n > old && !max.compare_exchange_weak(old, n, std::memory_order_relaxed)) {}
+  }
+  std::string name;
+  bool timer;
+  std::atomic<uint64_t> calls;
+  std::atomic<double> total; // ns for timers
+  std::atomic<double> max;
+  std::atomic<uint64_t> allocations;
+};
+
+// Counted by the operator new in profile.cxx, which exactly one translation unit of a program compiles
+inline std::atomic<uint64_t> g_profileAllocations(0);
+inline std::atomic<uint64_t> g_profileAllocatedBytes(0);
+
+class profiler {
+public:
+  static profiler& get() {
+    static profiler instance;
+    return instance;
+  }
+
+  profileEntry& entry(const std::string& name, const bool timer) {
+    std::lock_guard<std::mutex> lock(m_mutex); // Call sites on different threads can look up their entries at once
+    for (profileEntry* e : m_entries) {
+      if (e->name == name && e->timer == timer) return *e; // Same name from two call sites
+    }
+    m_entries.push_back(new profileEntry(name, timer));
+    return *m_entries.back();
+  }
+
+  void summary() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::cout << std::endl << std::fixed << std::setprecision(3) << std::left << std::setw(32) << "Phase" << std::right
+      << std::setw(12) << "Calls" << std::setw(14) << "Total [ms]" << std::setw(14) << "Mean [us]" << std::setw(14) << "Allocs" << std::endl;
+    for (const profileEntry* e : m_entries) {
+      if (!e->timer) continue;
+      const uint64_t calls = e->calls.load();
+      const double total = e->total.load();
+      std::cout << std::left << std::setw(32) << e->name << std::right << std::setw(12) << calls << std::setw(14) << total * 1e-6
+        << std::setw(14) << (calls ? total * 1e-3 / calls : 0.) << std::setw(14) << e->allocations.load() << std::endl;
+    }
+    std::cout << std::endl << std::left << std::setw(32) << "Counter" << std::right
+      << std::setw(12) << "Calls" << std::setw(14) << "Total" << std::setw(14) << "Mean" << std::setw(14) << "Max" << std::endl;
+    for (const profileEntry* e : m_entries) {
+      if (e->timer) continue;
+      const uint64_t calls = e->calls.load();
+      const double total = e->total.load();
+      std::cout << std::left << std::setw(32) << e->name << std::right << std::setw(12) << calls << std::setw(14) << std::setprecision(0) << total
+        << std::setw(14) << std::setprecision(3) << (calls ? total / calls : 0.) << std::setw(14) << std::setprecision(0) << e->max.load() << std::endl;
+    }
+    std::cout << std::left << std::setw(32) << "Heap allocations" << std::right << std::setw(12) << g_profileAllocations.load()
+      << std::setw(14) << g_profileAllocatedBytes.load() << " bytes" << std::endl << std::defaultfloat << std::endl;
+  }
+
+private:
+  profiler() {}
+  std::vector<profileEntry*> m_entries; // Never freed, call sites hold references
+  std::mutex m_mutex;
+};
+
+class scopedTimer {
+public:
+  scopedTimer(profileEntry& e) : m_entry(e), m_allocations(g_profileAllocations.load(std::memory_order_relaxed)), m_start(std::chrono::steady_clock::now()) {}
+  ~scopedTimer() {
+    m_entry.add(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - m_start).count());
+    m_entry.allocations.fetch_add(g_profileAllocations.load(std::memory_order_relaxed) - m_allocations, std::memory_order_relaxed);
+  }
+private:
+  profileEntry& m_entry;
+  uint64_t m_allocations;
+  std::chrono::steady_clock::time_point m_start;
+};
+
+#define WCMC_PROFILE_CONCAT2(a, b) a##b
+#define WCMC_PROFILE_CONCAT(a, b) WCMC_PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(name) \
+  static profileEntry& WCMC_PROFILE_CONCAT(_profileEntry, __LINE__) = profiler::get().entry(name, true); \
+  scopedTimer WCMC_PROFILE_CONCAT(_profileTimer, __LINE__)(WCMC_PROFILE_CONCAT(_profileEntry, __LINE__))
+#define PROFILE_COUNT(name, n) do { static profileEntry& _e = profiler::get().entry(name, false); _e.add(n); } while (0)
+#define PROFILE_MAX(name, n) do { static profileEntry& _e = profiler::get().entry(name, false); _e.set(n); } while (0)
+#define PROFILE_SUMMARY() profiler::get().summary()
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNT(name, n) do { (void)sizeof(n); } while (0)
+#define PROFILE_MAX(name, n) do { (void)sizeof(n); } while (0)
+#define PROFILE_SUMMARY() do {} while (0)
+
+#endif // WCMC_PROFILE
+
+#endif // WCMC_PROFILE_H
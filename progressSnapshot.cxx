@@ -0,0 +1,138 @@
+#include "progressSnapshot.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <sys/resource.h>
+#include <unistd.h>
+
+static const std::chrono::milliseconds kSnapshotPoll(50); // Timer thread reaction time to stop()
+
+namespace {
+  // Names are from the data files, escape anything JSON would not take literally
+  std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (const char c : s) {
+      if (c == '"' || c == '\\') out += '\\';
+      if ((unsigned char) c < 0x20) continue;
+      out += c;
+    }
+    return out + "\"";
+  }
+
+  uint64_t residentBytes() {
+    long pages = 0, resident = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f == nullptr) return 0;
+    if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    fclose(f);
+    return (uint64_t) resident * sysconf(_SC_PAGESIZE);
+  }
+
+  uint64_t peakResidentBytes() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t) usage.ru_maxrss * 1024; // kB on Linux
+  }
+}
+
+void progressSnapshot::start(const std::string& fname, const double intervalSeconds) {
+  stop();
+  m_fname = fname;
+  m_interval = std::chrono::duration<double>(intervalSeconds);
+  m_start = std::chrono::steady_clock::now();
+  m_last = progressState();
+  m_stop.store(false);
+  m_due.store(true); // A first snapshot straight away
+  m_running = true;
+  m_timer = std::thread(&progressSnapshot::run, this);
+}
+
+void progressSnapshot::stop() {
+  if (!m_running) return;
+  m_stop.store(true);
+  m_timer.join();
+  m_running = false;
+  m_due.store(false);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_pending) write(m_state);
+  m_pending = false;
+}
+
+void progressSnapshot::publish(const progressState& state) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_state = state; // Reuses the previous copy's buffers
+  m_state.time = std::chrono::steady_clock::now();
+  m_pending = true;
+  m_due.store(false, std::memory_order_relaxed);
+}
+
+void progressSnapshot::run() {
+  std::chrono::steady_clock::time_point next = m_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(m_interval);
+  progressState state;
+  while (!m_stop.load()) {
+    std::this_thread::sleep_for(kSnapshotPoll);
+    bool pending = false;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_pending) {
+        std::swap(state, m_state);
+        m_pending = false;
+        pending = true;
+      }
+    }
+    if (pending) write(state);
+    if (std::chrono::steady_clock::now() >= next) {
+      m_due.store(true, std::memory_order_relaxed);
+      next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(m_interval);
+    }
+  }
+}
+
+bool progressSnapshot::write(const progressState& state) {
+  const double elapsed = std::chrono::duration<double>(state.time - m_start).count();
+  const bool samePhase = (state.phase == m_last.phase && state.phaseStart == m_last.phaseStart);
+  const double sinceLast = std::chrono::duration<double>(state.time - (samePhase ? m_last.time : state.phaseStart)).count();
+  const double phaseElapsed = std::chrono::duration<double>(state.time - state.phaseStart).count();
+  const double rate = (phaseElapsed > 0 ? state.trialsDone / phaseElapsed : 0);
+  const std::string tmp = m_fname + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "w");
+  if (f == nullptr) {
+    std::cout << "Error. Cannot write progress snapshot " << tmp << std::endl;
+    return false;
+  }
+  fprintf(f, "{\n  \"phase\": %s,\n  \"year\": %d,\n  \"mode\": %d,\n", jsonString(state.phase).c_str(), state.year, state.mode);
+  fprintf(f, "  \"trialsDone\": %lu,\n  \"trialsTotal\": %lu,\n", (unsigned long) state.trialsDone, (unsigned long) state.trialsTotal);
+  fprintf(f, "  \"elapsedSeconds\": %.3f,\n  \"trialsPerSecond\": %.1f,\n", elapsed, rate);
+  fprintf(f, "  \"etaSeconds\": %.1f,\n", (rate > 0 ? (state.trialsTotal - std::min(state.trialsDone, state.trialsTotal)) / rate : -1.));
+  fprintf(f, "  \"threads\": [");
+  for (size_t t = 0; t < state.threadTrials.size(); ++t) {
+    const uint64_t before = (samePhase && t < m_last.threadTrials.size() ? m_last.threadTrials[t] : 0);
+    const double threadRate = (sinceLast > 0 && state.threadTrials[t] >= before ? (state.threadTrials[t] - before) / sinceLast : 0);
+    fprintf(f, "%s\n    {\"thread\": %zu, \"trials\": %lu, \"trialsPerSecond\": %.1f}", (t ? "," : ""), t, (unsigned long) state.threadTrials[t], threadRate);
+  }
+  fprintf(f, "\n  ],\n");
+  fprintf(f, "  \"tuning\": {\"low\": %.4g, \"high\": %.4g, \"chi2\": %.6g},\n", state.tuningLow, state.tuningHigh, state.tuningChi2);
+  fprintf(f, "  \"memory\": {\"residentBytes\": %lu, \"peakResidentBytes\": %lu},\n", (unsigned long) residentBytes(), (unsigned long) peakResidentBytes());
+  // Fraction of trials in which the team passed the stage, with its binomial standard error
+  fprintf(f, "  \"teams\": [");
+  const double n = state.trialsDone;
+  for (size_t t = 0; t < state.teams.size(); ++t) {
+    fprintf(f, "%s\n    {\"name\": %s, \"stages\": {", (t ? "," : ""), jsonString(state.teams[t]).c_str());
+    for (size_t s = 0; s < state.stages.size(); ++s) {
+      const double p = (n > 0 ? state.stageCounts.at(t).at(s) / n : 0);
+      const double se = (n > 0 ? std::sqrt(p * (1. - p) / n) : 0);
+      fprintf(f, "%s%s: {\"p\": %.6g, \"se\": %.3g}", (s ? ", " : ""), jsonString(state.stages[s]).c_str(), p, se);
+    }
+    fprintf(f, "}}");
+  }
+  fprintf(f, "\n  ]\n}\n");
+  const bool ok = (fclose(f) == 0 && rename(tmp.c_str(), m_fname.c_str()) == 0);
+  if (!ok) {
+    std::cout << "Error. Cannot write progress snapshot " << m_fname << std::endl;
+    remove(tmp.c_str());
+  }
+  m_last = state;
+  return ok;
+}
@@ -0,0 +1,57 @@
+#ifndef WCMC_PROGRESSSNAPSHOT_H
+#define WCMC_PROGRESSSNAPSHOT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Progress of a long run as a small JSON file, rewritten atomically (write and rename) every few seconds for dashboards.
+// A timer thread raises due() once per interval, the simulation then hands over its counters with publish() and the timer
+// thread formats and writes them. The simulation only pays for checking due() and for copying the counters.
+
+struct progressState {
+  std::string phase; // "training" or "simulation"
+  int year = 0;
+  int mode = 0;
+  uint64_t trialsDone = 0;
+  uint64_t trialsTotal = 0;
+  std::vector<uint64_t> threadTrials; // Trials done by each simulation thread
+  double tuningLow = 0, tuningHigh = 0, tuningChi2 = -1; // Best so far when training, -1 if none yet
+  std::vector<std::string> stages;
+  std::vector<std::string> teams;
+  std::vector<std::vector<double>> stageCounts; // [team][stage], trials in which the team passed the stage
+  std::chrono::steady_clock::time_point phaseStart; // Rates and the ETA count from here
+  std::chrono::steady_clock::time_point time; // Set by publish()
+};
+
+class progressSnapshot {
+public:
+  progressSnapshot() : m_due(false), m_stop(false), m_pending(false), m_running(false) {}
+  ~progressSnapshot() { stop(); }
+
+  void start(const std::string& fname, const double intervalSeconds);
+  void stop(); // Writes the last state published
+  bool due() const { return m_due.load(std::memory_order_relaxed); }
+  void publish(const progressState& state);
+
+private:
+  void run();
+  bool write(const progressState& state);
+
+  std::string m_fname;
+  std::chrono::duration<double> m_interval;
+  std::chrono::steady_clock::time_point m_start;
+  std::atomic<bool> m_due, m_stop;
+  std::mutex m_mutex; // Guards m_state and m_pending
+  progressState m_state;
+  bool m_pending;
+  bool m_running;
+  std::thread m_timer;
+  progressState m_last; // Timer thread only, for the rates since the previous snapshot
+};
+
+#endif // WCMC_PROGRESSSNAPSHOT_H
@@ -7,6 +7,10 @@
 #include <TRandom3.h>
 #include <TROOT.h>
 #include <TH2.h>
+#include "toyBets.h"
+#include "betStrategy.h"
+#include <thread>
+#include <atomic>
 
 std::vector<std::string> readLine(const std::string& line) {
   std::istringstream buf(line);
@@ -19,12 +23,207 @@ std::vector<std::string> readLine(const std::string& line) {
   return results;
 }
 
-int main() {
+// Chunks of rounds are handed out to the threads, play(thread, R, rounds) counts into that thread's bins.
+// Each chunk has its own seed so the totals do not depend on the number of threads.
+unsigned toyThreads(const long rounds) {
+  const long chunks = (rounds + kToyRoundsPerChunk - 1) / kToyRoundsPerChunk;
+  return std::max(std::min(std::thread::hardware_concurrency(), (unsigned) chunks), 1u);
+}
+
+template <typename F>
+void runChunks(const long rounds, const unsigned nThreads, F play) {
+  const long chunks = (rounds + kToyRoundsPerChunk - 1) / kToyRoundsPerChunk;
+  std::atomic<long> nextChunk(0);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < nThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (long chunk = nextChunk++; chunk < chunks; chunk = nextChunk++) {
+        TRandom3 R(chunk + 1); // 0 would be a random seed
+        play(t, R, std::min(kToyRoundsPerChunk, rounds - chunk * kToyRoundsPerChunk));
+        if (chunk % 10 == 0) std::cout << "Round " + std::to_string(chunk * kToyRoundsPerChunk) + "\n" << std::flush;
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+}
+
+// Return distributions for every bias in one pass, sampled and exact. Negative biases are generous, positive unfair.
+int biasSweep(const std::vector<double>& oddsVec, const std::vector<double>& biases, const long rounds, const double actual) {
+  std::vector<std::vector<double>> pWin;
+  for (const double bias : biases) pWin.push_back(toyOdds(oddsVec, bias).low);
+
+  const unsigned nThreads = toyThreads(rounds);
+  std::vector<std::vector<std::vector<long>>> counts(nThreads, std::vector<std::vector<long>>(biases.size(), std::vector<long>(returnGridSize(oddsVec))));
+  std::vector<std::vector<double>> u(nThreads);
+  runChunks(rounds, nThreads, [&](const unsigned t, TRandom3& R, const long n) { playSweep(R, oddsVec, pWin, n, counts.at(t), u.at(t)); });
+
+  const int n = biases.size();
+  std::vector<double> zero(n, 0.), stake(n), stakeErr(n), stakeExact(n), mean(n);
+  std::cout << "bias mean P(return>=" << oddsVec.size() << ") exact P(return>=" << actual << ") exact" << std::endl;
+  for (int b = 0; b < n; ++b) {
+    std::vector<double> p(returnGridSize(oddsVec), 0.);
+    for (unsigned t = 0; t < nThreads; ++t) {
+      for (size_t i = 0; i < p.size(); ++i) p[i] += counts.at(t).at(b).at(i);
+    }
+    for (size_t i = 0; i < p.size(); ++i) {
+      p[i] /= rounds;
+      mean[b] += p[i] * i * kExactStep;
+    }
+    const std::vector<double> exact = exactReturns(oddsVec, pWin.at(b));
+    stake[b] = exactTail(p, oddsVec.size());
+    stakeErr[b] = std::sqrt(stake[b] * (1. - stake[b]) / rounds);
+    stakeExact[b] = exactTail(exact, oddsVec.size());
+    std::cout << biases[b] << " " << mean[b] << " " << stake[b] << " " << stakeExact[b] << " " << exactTail(p, actual) << " " << exactTail(exact, actual) << std::endl;
+  }
+
+  nicePlot* np = new nicePlot();
+  np->useAltColourScheme(1);
+  np->setAutoxy(1, 1);
+  np->setLineWidth(4);
+  np->init("Bookmaker bias", "P(Return >= Stake)");
+  np->setLegend(.7, .7);
+  np->addMC(new TGraphAsymmErrors(n, biases.data(), stake.data(), zero.data(), zero.data(), stakeErr.data(), stakeErr.data()), "Sampled");
+  np->addMC(new TGraphAsymmErrors(n, biases.data(), stakeExact.data()), "Exact");
+  bookOutput::get().doBookOutput("toyBets_sweep");
+  return 0;
+}
+
+// The odds file prices one exact score per game but does not say which, it is taken to be the model's most likely score.
+// Every staking setting is played on the real outcomes and on the same simulated tournaments, and written to toyBets_backtest.csv
+int betBacktest(const std::string& modelFile, std::vector<pricedBet> bets, const long bankrolls) {
+  struct fixturePMF { std::string teamA, teamB; double p[8][8]; };
+  std::vector<fixturePMF> fixtures;
+  std::map<std::string, size_t> fixtureIndex;
+  std::ifstream in(modelFile);
+  std::string line;
+  while ( getline(in, line) ) {
+    std::vector<std::string> f;
+    std::istringstream ss(line);
+    for (std::string field; getline(ss, field, ','); ) f.push_back(field);
+    if (f.size() != 6 || f[0] != "score") continue;
+    const std::string key = f[1] + "_" + f[2];
+    if (fixtureIndex.count(key) == 0) {
+      fixtureIndex[key] = fixtures.size();
+      fixtures.push_back(fixturePMF{f[1], f[2], {}});
+    }
+    const int a = std::stoi(f[3]), b = std::stoi(f[4]);
+    if (a >= 0 && a < 8 && b >= 0 && b < 8) fixtures.at(fixtureIndex[key]).p[a][b] = std::stod(f[5]);
+  }
+  if (fixtures.empty()) {
+    std::cout << "Error. No score matrices in " << modelFile << std::endl;
+    return 1;
+  }
+
+  std::vector<pricedBet> matched;
+  for (pricedBet& bet : bets) {
+    const size_t split = bet.fixture.find(" v ");
+    if (split == std::string::npos) continue;
+    const std::string teamA = bet.fixture.substr(0, split), teamB = bet.fixture.substr(split + 3);
+    bool found = false;
+    for (const fixturePMF& fixture : fixtures) {
+      const bool forward = sameTeam(teamA, fixture.teamA) && sameTeam(teamB, fixture.teamB);
+      if (!forward && !(sameTeam(teamA, fixture.teamB) && sameTeam(teamB, fixture.teamA))) continue;
+      bet.p = -1;
+      for (int a = 0; a < 8; ++a) {
+        for (int b = 0; b < 8; ++b) {
+          if (fixture.p[a][b] <= bet.p) continue;
+          bet.p = fixture.p[a][b];
+          bet.goalsA = (forward ? a : b);
+          bet.goalsB = (forward ? b : a);
+        }
+      }
+      found = true;
+      break;
+    }
+    if (found) matched.push_back(bet);
+    else std::cout << "No score matrix for " << bet.fixture << ", not bet" << std::endl;
+  }
+
+  // The results file is in the same order, as far as it goes, check the outcomes agree with the score assumed to be backed
+  std::ifstream resultsFile("wc_2018_results.txt");
+  std::vector<std::pair<int, int>> scores;
+  while ( getline(resultsFile, line) ) {
+    std::vector<std::string> results = readLine(line);
+    if (results.size() >= 2 && results[0] != "#") scores.push_back(std::make_pair(std::stoi(results[0]), std::stoi(results[1])));
+  }
+  int agree = 0, checked = 0;
+  for (const pricedBet& bet : matched) {
+    if (bet.game < 1 || bet.game > (int) scores.size()) continue;
+    ++checked;
+    agree += (bet.won == (scores.at(bet.game - 1) == std::make_pair(bet.goalsA, bet.goalsB)));
+  }
+  std::cout << matched.size() << " bets, outcome agrees with the model's most likely score in " << agree << "/" << checked << " games" << std::endl;
+
+  std::vector<stakeRule> rules(1, stakeRule(kFlatStake, 0));
+  for (int i = -500; i <= 1000; ++i) rules.push_back(stakeRule(kValueStake, i * 0.001));
+  for (int i = 1; i <= 1000; ++i) rules.push_back(stakeRule(kKellyStake, i * 0.001));
+
+  // Common random numbers, every setting sees the same simulated tournaments
+  std::vector<double> u(matched.size() * bankrolls);
+  TRandom3 R(1);
+  R.RndmArray(u.size(), u.data());
+  std::vector<bankrollSummary> summaries(rules.size());
+  const unsigned nThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < nThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      std::vector<double> bank;
+      for (size_t i = t; i < rules.size(); i += nThreads) summaries.at(i) = playStrategy(rules.at(i), matched, u, bankrolls, bank);
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+
+  std::ofstream out("toyBets_backtest.csv");
+  out << "rule,param,bets,staked,realised,mean,median,p05,p95,pLoss" << std::endl;
+  size_t best[3] = {0, 0, 0}; // Highest median per rule
+  for (size_t i = 0; i < rules.size(); ++i) {
+    const bankrollSummary& s = summaries.at(i);
+    out << rules.at(i).name() << "," << rules.at(i).param << "," << s.bets << "," << s.staked << "," << s.realised << ","
+      << s.mean << "," << s.median << "," << s.p05 << "," << s.p95 << "," << s.pLoss << std::endl;
+    size_t& b = best[rules.at(i).rule];
+    if (b == 0 || s.median > summaries.at(b).median) b = i;
+  }
+  std::cout << "rule param bets staked realised | model: mean median p05 p95 P(loss), from " << kStartBankroll << std::endl;
+  for (const size_t i : best) {
+    const bankrollSummary& s = summaries.at(i);
+    std::cout << rules.at(i).name() << " " << rules.at(i).param << " " << s.bets << " " << s.staked << " " << s.realised << " | "
+      << s.mean << " " << s.median << " " << s.p05 << " " << s.p95 << " " << s.pLoss << std::endl;
+  }
+  std::cout << "Wrote " << rules.size() << " settings to toyBets_backtest.csv" << std::endl;
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+
+  bool exact = false; // Convolve the payouts instead of sampling rounds
+  long rounds = 100000000;
+  std::vector<double> sweep; // Biases to evaluate together on the same random numbers
+  std::string model; // Results file from wcMC.exe --year 2018 --mode 0 --results, to backtest staking strategies with
+  long bankrolls = 10000;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool hasValue = (i + 1 < argc);
+    if      (arg == "--exact") exact = true;
+    else if (arg == "--rounds" && hasValue) rounds = std::stol(argv[++i]);
+    else if (arg == "--sweep" && hasValue) {
+      std::istringstream biases(argv[++i]);
+      std::string bias;
+      while ( getline(biases, bias, ',') ) sweep.push_back(std::stod(bias));
+    }
+    else if (arg == "--backtest" && hasValue) model = argv[++i];
+    else if (arg == "--bankrolls" && hasValue) bankrolls = std::stol(argv[++i]);
+    else {
+      std::cout << "Usage: toyBets.exe [--exact] [--rounds N] [--sweep -0.2,-0.1,0,0.1,0.2]" << std::endl;
+      std::cout << "       toyBets.exe --backtest WCMC_results.csv [--bankrolls N]" << std::endl;
+      return 1;
+    }
+  }
 
   std::string line;
   std::ifstream odds("wc_2018_odds.txt");
   double winnings = 0;
   std::vector<double> oddsVec;
+  std::vector<pricedBet> bets;
 
  TH1* oddsHist = new TH1D("", "", 18, 3.75, 12.75); 
 
@@ -40,35 +239,55 @@ int main() {
     if (results[1] == "W") {
       winnings += stof(results[0]);
     }
-    std:cout << "Game " << ++game << " | Odd:1 in " << results[0] << " (" << results[1] 
+    pricedBet bet;
+    for (size_t i = 2; i < results.size(); ++i) bet.fixture += (i > 2 ? " " : "") + results[i];
+    bet.odd = stof(results[0]);
+    bet.won = (results[1] == "W");
+    bet.game = game + 1;
+    bets.push_back(bet);
+    std::cout << "Game " << ++game << " | Odd:1 in " << results[0] << " (" << results[1] 
       << "). Winnings Status:" << winnings << (results[1] == "W" ? "         !!!" : "") << std::endl;
   }
   odds.close();
 
   std::cout << std::endl << "Total winnings:" << winnings << std::endl;
   
-  TH1* probDist = new TH1D("", "", 180*2, 0., 180.); 
-  TH1* probDistLow = new TH1D("", "", 180*2, 0., 180.); 
-  TH1* probDistHgh = new TH1D("", "", 180*2, 0., 180.); 
+  TH1* probDist = new TH1D("", "", kToyBins, kToyMin, kToyMax); 
+  TH1* probDistLow = new TH1D("", "", kToyBins, kToyMin, kToyMax); 
+  TH1* probDistHgh = new TH1D("", "", kToyBins, kToyMin, kToyMax); 
 
  
   const double bias = 0.2;
-  
-  TRandom3 R;
-  
-  for (int round = 0; round < 100000000; ++round) {
-    double winnings = 0, winningsLow = 0, winningsHgh = 0;
-    for (const double odd : oddsVec) {
-      if (R.Rndm() < 1. / odd) winnings += odd;
-      if (R.Rndm() < 1. / (odd * (1. + bias))) winningsLow += odd;
-      if (R.Rndm() < 1. / (odd * (1. - bias))) winningsHgh += odd;
-    } 
-    probDist->Fill(winnings - .01); 
-    probDistLow->Fill(winningsLow - .01);
-    probDistHgh->Fill(winningsHgh - .01);
-    if (round % 10000000 == 0) std::cout << "Round " << round << " winnings " << winnings << std::endl;
-  }
+  const toyOdds toy(oddsVec, bias);
+
+  if (!sweep.empty()) return biasSweep(oddsVec, sweep, rounds, winnings);
+  if (!model.empty()) return betBacktest(model, bets, bankrolls);
 
+  if (exact) {
+    const std::vector<double> dists[3] = {exactReturns(toy.odd, toy.fair), exactReturns(toy.odd, toy.low), exactReturns(toy.odd, toy.hgh)};
+    TH1* hists[3] = {probDist, probDistLow, probDistHgh};
+    const char* names[3] = {"Fair", "Unfair", "Generous"};
+    for (int d = 0; d < 3; ++d) {
+      for (size_t i = 0; i < dists[d].size(); ++i) {
+        const int b = toyBin(i * kExactStep);
+        hists[d]->SetBinContent(b, hists[d]->GetBinContent(b) + dists[d].at(i));
+      }
+      std::cout << names[d] << ": P(return >= " << oddsVec.size() << ") = " << exactTail(dists[d], oddsVec.size())
+        << ", P(return >= " << winnings << ") = " << exactTail(dists[d], winnings) << std::endl;
+    }
+  } else {
+    const unsigned nThreads = toyThreads(rounds);
+    std::vector<toyCounts> counts(nThreads);
+    std::vector<std::vector<double>> u(nThreads);
+    runChunks(rounds, nThreads, [&](const unsigned t, TRandom3& R, const long n) { playRounds(R, toy, n, counts.at(t), u.at(t)); });
+    for (unsigned t = 1; t < nThreads; ++t) counts.at(0).add(counts.at(t));
+    for (int b = 0; b < kToyBins + 2; ++b) {
+      probDist->SetBinContent(b, counts.at(0).fair[b]);
+      probDistLow->SetBinContent(b, counts.at(0).low[b]);
+      probDistHgh->SetBinContent(b, counts.at(0).hgh[b]);
+    }
+    for (TH1* h : {probDist, probDistLow, probDistHgh}) h->SetEntries(rounds);
+  }
 
   nicePlot* npOdds = new nicePlot();
   npOdds->setAutox(1);
@@ -103,7 +322,7 @@ int main() {
 
 
 int toyBets() {
-  return main();
+  return main(0, nullptr);
 }
 
 /*
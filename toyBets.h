@@ -0,0 +1,123 @@
+#ifndef WCMC_TOYBETS_H
+#define WCMC_TOYBETS_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <TRandom3.h>
+
+// Return distribution binning, as the probDist histograms. Counts have the underflow first and the overflow last, as TH1 bins
+const int kToyBins = 360;
+const double kToyMin = 0., kToyMax = 180.;
+const int kToyBatch = 64; // Rounds played side by side, the Bernoulli trials of a batch vectorise
+const long kToyRoundsPerChunk = 1000000; // Each chunk has its own seed, so results do not depend on the number of threads
+
+// Win thresholds per game at fair odds and with the bookmaker's bias either way
+struct toyOdds {
+  toyOdds(const std::vector<double>& oddsVec, const double bias) : odd(oddsVec) {
+    for (const double o : oddsVec) {
+      fair.push_back(1. / o);
+      low.push_back(1. / (o * (1. + bias)));
+      hgh.push_back(1. / (o * (1. - bias)));
+    }
+  }
+  std::vector<double> odd, fair, low, hgh;
+};
+
+struct toyCounts {
+  toyCounts() : fair(kToyBins + 2), low(kToyBins + 2), hgh(kToyBins + 2) {}
+  void add(const toyCounts& other) {
+    for (int b = 0; b < kToyBins + 2; ++b) {
+      fair[b] += other.fair[b];
+      low[b] += other.low[b];
+      hgh[b] += other.hgh[b];
+    }
+  }
+  std::vector<long> fair, low, hgh;
+};
+
+inline int toyBin(const double winnings) {
+  const double x = winnings - .01; // Exact returns go in the bin below
+  if (x < kToyMin) return 0;
+  if (x >= kToyMax) return kToyBins + 1;
+  return 1 + (int)((x - kToyMin) * kToyBins / (kToyMax - kToyMin));
+}
+
+// Rounds of betting one unit on every game, added to counts. u is scratch space for the random numbers
+inline void playRounds(TRandom3& R, const toyOdds& odds, const long rounds, toyCounts& counts, std::vector<double>& u) {
+  const size_t games = odds.odd.size();
+  u.resize(3 * kToyBatch * games);
+  for (long done = 0; done < rounds; done += kToyBatch) {
+    const int batch = (int) std::min((long) kToyBatch, rounds - done);
+    R.RndmArray(3 * batch * games, u.data());
+    double winnings[kToyBatch] = {}, winningsLow[kToyBatch] = {}, winningsHgh[kToyBatch] = {};
+    const double* uFair = u.data();
+    const double* uLow = uFair + batch * games;
+    const double* uHgh = uLow + batch * games;
+    for (size_t g = 0; g < games; ++g) {
+      const double odd = odds.odd[g], fair = odds.fair[g], low = odds.low[g], hgh = odds.hgh[g];
+      for (int r = 0; r < batch; ++r) { // Branch free, one lane per round
+        winnings[r] += (uFair[g * batch + r] < fair ? odd : 0.);
+        winningsLow[r] += (uLow[g * batch + r] < low ? odd : 0.);
+        winningsHgh[r] += (uHgh[g * batch + r] < hgh ? odd : 0.);
+      }
+    }
+    for (int r = 0; r < batch; ++r) {
+      ++counts.fair[toyBin(winnings[r])];
+      ++counts.low[toyBin(winningsLow[r])];
+      ++counts.hgh[toyBin(winningsHgh[r])];
+    }
+  }
+}
+
+// Exact distribution of the return, the sum of independent Bernoulli(pWin) payouts of odd, by convolving one game at a time.
+// Element i is the probability of a return of i * kExactStep, payouts are rounded to this grid.
+const double kExactStep = 0.1;
+
+inline std::vector<double> exactReturns(const std::vector<double>& odd, const std::vector<double>& pWin) {
+  std::vector<double> p(1, 1.);
+  for (size_t g = 0; g < odd.size(); ++g) {
+    const size_t step = std::lround(odd[g] / kExactStep);
+    p.resize(p.size() + step, 0.);
+    for (size_t i = p.size(); i-- > 0;) { // Downwards, so p[i - step] is still from the previous game
+      p[i] = p[i] * (1. - pWin[g]) + (i >= step ? p[i - step] * pWin[g] : 0.);
+    }
+  }
+  return p;
+}
+
+// Size of the payout grid, up to every game won
+inline size_t returnGridSize(const std::vector<double>& odd) {
+  size_t n = 1;
+  for (const double o : odd) n += std::lround(o / kExactStep);
+  return n;
+}
+
+inline double exactTail(const std::vector<double>& p, const double x) {
+  double tail = 0;
+  for (size_t i = std::max(std::ceil(x / kExactStep - 1e-6), 0.); i < p.size(); ++i) tail += p[i];
+  return tail;
+}
+
+// One uniform per round and game, compared against the win threshold of every bias so that the curves share their random numbers.
+// counts[b] is indexed as exactReturns, and sized by returnGridSize. Payouts are summed as whole grid steps, as exactReturns does.
+inline void playSweep(TRandom3& R, const std::vector<double>& odd, const std::vector<std::vector<double>>& pWin, const long rounds,
+  std::vector<std::vector<long>>& counts, std::vector<double>& u) {
+  const size_t games = odd.size();
+  u.resize(kToyBatch * games);
+  for (long done = 0; done < rounds; done += kToyBatch) {
+    const int batch = (int) std::min((long) kToyBatch, rounds - done);
+    R.RndmArray(batch * games, u.data());
+    for (size_t b = 0; b < pWin.size(); ++b) {
+      long winnings[kToyBatch] = {};
+      for (size_t g = 0; g < games; ++g) {
+        const long step = std::lround(odd[g] / kExactStep);
+        const double p = pWin[b][g];
+        for (int r = 0; r < batch; ++r) winnings[r] += (u[g * batch + r] < p ? step : 0);
+      }
+      for (int r = 0; r < batch; ++r) ++counts[b][winnings[r]];
+    }
+  }
+}
+
+#endif // WCMC_TOYBETS_H
@@ -0,0 +1,250 @@
+#include "trialQuery.h"
+
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+
+namespace {
+  const char* kStageName[kStages] = {"R16", "QF", "SF", "F", "W"};
+  const int kStageFirstKO[kStages] = {0, 8, 12, 15, 15}; // Knockout columns whose participants reached the stage
+  const int kStageLastKO[kStages]  = {8, 12, 14, 16, 16};
+
+  std::string trim(const std::string& s) {
+    const size_t b = s.find_first_not_of(" \t");
+    if (b == std::string::npos) return "";
+    return s.substr(b, s.find_last_not_of(" \t") - b + 1);
+  }
+
+  // The whole of s, blanks aside, as an int
+  bool parseNumber(const std::string& s, int& value) {
+    const std::string t = trim(s);
+    char* end = nullptr;
+    errno = 0;
+    const long v = strtol(t.c_str(), &end, 10);
+    if (t.empty() || *end != '\0' || errno != 0 || v < INT_MIN || v > INT_MAX) return false;
+    value = v;
+    return true;
+  }
+
+  void andInto(bitmap& a, const bitmap& b) {
+    for (size_t w = 0; w < a.size(); ++w) a[w] &= b[w];
+  }
+
+  // Set bit i of the word for each of the 64 trials whose byte matches
+  template <typename T, typename Pred>
+  void scanColumn(const T* col, const int n, uint64_t* words, Pred pred) {
+    for (int w = 0; w < n / 64; ++w) {
+      uint64_t bits = 0;
+      for (int b = 0; b < 64; ++b) bits |= (uint64_t)pred(col[(w * 64) + b]) << b;
+      words[w] |= bits;
+    }
+    for (int b = (n / 64) * 64; b < n; ++b) words[b / 64] |= (uint64_t)pred(col[b]) << (b % 64);
+  }
+}
+
+trialQuery::trialQuery(const trialReader& store) : m_store(store) {
+  m_words = (m_store.trials() + 63) / 64;
+  m_all.assign(m_words, ~0ull);
+  if (m_store.trials() % 64) m_all.back() = (1ull << (m_store.trials() % 64)) - 1;
+}
+
+uint64_t trialQuery::count(const bitmap& b) const {
+  uint64_t n = 0;
+  for (const uint64_t w : b) n += __builtin_popcountll(w);
+  return n;
+}
+
+const bitmap& trialQuery::teamStage(const int team, const Stage stage) {
+  const int key = (team * kStages) + stage;
+  std::map<int, bitmap>::iterator it = m_teamStage.find(key);
+  if (it != m_teamStage.end()) return it->second;
+  bitmap& b = m_teamStage[key];
+  b.assign(m_words, 0);
+  const uint8_t id = team;
+  for (uint64_t block = 0; block < m_store.blocks(); ++block) {
+    uint64_t* words = b.data() + (block * m_store.header().blockTrials / 64);
+    const int n = m_store.trialsInBlock(block);
+    for (int ko = kStageFirstKO[stage]; ko < kStageLastKO[stage]; ++ko) {
+      scanColumn(m_store.winner(block, ko), n, words, [id](uint8_t v) { return v == id; });
+      if (stage != kStageWinner) scanColumn(m_store.loser(block, ko), n, words, [id](uint8_t v) { return v == id; });
+    }
+  }
+  return b;
+}
+
+const bitmap& trialQuery::matchWinner(const int match, const int team) {
+  const int key = (match * kStoreMaxTeams) + team;
+  std::map<int, bitmap>::iterator it = m_matchWinner.find(key);
+  if (it != m_matchWinner.end()) return it->second;
+  bitmap& b = m_matchWinner[key];
+  b.assign(m_words, 0);
+  const int slot = match - 1;
+  const uint8_t id = team;
+  const trialStoreHeader& h = m_store.header();
+  for (uint64_t block = 0; block < m_store.blocks(); ++block) {
+    uint64_t* words = b.data() + (block * h.blockTrials / 64);
+    const int n = m_store.trialsInBlock(block);
+    if (slot >= kGroupSlots) {
+      scanColumn(m_store.winner(block, slot - kGroupSlots), n, words, [id](uint8_t v) { return v == id; });
+    } else if (h.fixtureA[slot] == id) {
+      scanColumn(m_store.goals(block, slot), n, words, [](uint8_t v) { return v != kSlotNotPlayed && (v >> 4) > (v & 0xF); });
+    } else if (h.fixtureB[slot] == id) {
+      scanColumn(m_store.goals(block, slot), n, words, [](uint8_t v) { return v != kSlotNotPlayed && (v >> 4) < (v & 0xF); });
+    }
+  }
+  return b;
+}
+
+bitmap trialQuery::totalGoals(const bool greater, const int k) {
+  if (m_goals.empty()) {
+    m_goals.assign(m_words * 64, 0);
+    for (uint64_t block = 0; block < m_store.blocks(); ++block) {
+      uint16_t* sum = m_goals.data() + (block * m_store.header().blockTrials);
+      const int n = m_store.trialsInBlock(block);
+      for (int slot = 0; slot < kTrialSlots; ++slot) {
+        const uint8_t* col = m_store.goals(block, slot);
+        if (col[0] == kSlotNotPlayed) continue; // Slots are either played in every trial or in none
+        for (int i = 0; i < n; ++i) sum[i] += (col[i] >> 4) + (col[i] & 0xF);
+      }
+    }
+  }
+  bitmap b(m_words, 0);
+  if (greater) scanColumn(m_goals.data(), m_store.trials(), b.data(), [k](uint16_t v) { return v > k; });
+  else         scanColumn(m_goals.data(), m_store.trials(), b.data(), [k](uint16_t v) { return v < k; });
+  return b;
+}
+
+bool trialQuery::parseTerm(std::string term, bitmap& result) {
+  term = trim(term);
+  if (term.empty()) return false;
+  if (term[0] == '!') {
+    bitmap inner = m_all;
+    if (!parseTerm(term.substr(1), inner)) return false;
+    for (size_t w = 0; w < m_words; ++w) result[w] &= (~inner[w] & m_all[w]);
+    return true;
+  }
+  size_t pos;
+  int number = 0;
+  if (term.compare(0, 5, "goals") == 0 && (pos = term.find_first_of("<>")) != std::string::npos && parseNumber(term.substr(pos + 1), number)) {
+    andInto(result, totalGoals(term[pos] == '>', number));
+    return true;
+  }
+  if ((pos = term.find('@')) != std::string::npos) {
+    const int team = m_store.findTeam(trim(term.substr(0, pos)));
+    const std::string stage = trim(term.substr(pos + 1));
+    const int s = std::distance(kStageName, std::find(kStageName, kStageName + kStages, stage));
+    if (team < 0 || s == kStages) { std::cout << "Error. Unknown team or stage in '" << term << "'" << std::endl; return false; }
+    andInto(result, teamStage(team, (Stage) s));
+    return true;
+  }
+  if (term[0] == 'M' && (pos = term.find('=')) != std::string::npos && parseNumber(term.substr(1, pos - 1), number)) {
+    const int match = number;
+    const int team = m_store.findTeam(trim(term.substr(pos + 1)));
+    if (team < 0 || match < 1 || match > kTrialSlots) { std::cout << "Error. Unknown team or match in '" << term << "'" << std::endl; return false; }
+    andInto(result, matchWinner(match, team));
+    return true;
+  }
+  std::cout << "Error. Cannot parse query term '" << term << "'" << std::endl;
+  return false;
+}
+
+bool trialQuery::parseConjunction(const std::string& text, bitmap& result) {
+  result = m_all;
+  std::istringstream ss(text);
+  std::string term;
+  while (std::getline(ss, term, '&')) {
+    if (!parseTerm(term, result)) return false;
+  }
+  return true;
+}
+
+bool trialQuery::parseVariable(const std::string& text, std::vector<bitmap>& values, std::vector<std::string>& labels) {
+  const trialStoreHeader& h = m_store.header();
+  if (text.size() > 1 && text[0] == 'M' && isdigit(text[1])) {
+    int match = 0;
+    if (!parseNumber(text.substr(1), match) || match < 1 || match > kTrialSlots) return false;
+    for (uint32_t t = 0; t < h.nTeams; ++t) {
+      values.push_back(matchWinner(match, t));
+      labels.push_back(h.teamName[t]);
+    }
+    return true;
+  }
+  const int team = m_store.findTeam(text);
+  if (team < 0) return false;
+  values.push_back(m_all); // Furthest stage reached, exclusive
+  labels.push_back("Group");
+  for (int s = 0; s < kStages; ++s) {
+    const bitmap& reached = teamStage(team, (Stage) s);
+    for (size_t w = 0; w < m_words; ++w) values.front()[w] &= ~reached[w];
+    values.push_back(reached);
+    labels.push_back(kStageName[s]);
+  }
+  for (int s = 1; s < kStages; ++s) { // Remove those that went further
+    for (size_t w = 0; w < m_words; ++w) values.at(s)[w] &= ~values.at(s + 1)[w];
+  }
+  return true;
+}
+
+void trialQuery::printTable(const std::vector<std::pair<uint64_t, std::string>>& rows, const uint64_t norm) {
+  std::vector<std::pair<uint64_t, std::string>> sorted = rows;
+  std::stable_sort(sorted.begin(), sorted.end(), [](const std::pair<uint64_t, std::string>& a, const std::pair<uint64_t, std::string>& b) { return a.first > b.first; });
+  int print = 0;
+  for (const auto& [n, label] : sorted) {
+    if (n == 0 || ++print > 20) break;
+    std::cout << "  " << std::setw(40) << std::left << label << std::right << std::setw(12) << n << "  P = " << std::setprecision(5) << (norm ? n / (double)norm : 0.) << std::endl;
+  }
+}
+
+void trialQuery::run(const std::string& query) {
+  std::cout << "Query: " << query << std::endl;
+  std::string body = query, given;
+  const size_t bar = query.find('|');
+  if (bar != std::string::npos) {
+    body = query.substr(0, bar);
+    given = query.substr(bar + 1);
+  }
+  bitmap condition = m_all;
+  if (!given.empty() && !parseConjunction(given, condition)) return;
+  const uint64_t nCondition = count(condition);
+
+  std::istringstream words(body);
+  std::string verb;
+  words >> verb;
+  if (verb == "dist" || verb == "joint") {
+    std::string varA, varB;
+    words >> varA >> varB;
+    std::vector<bitmap> valuesA, valuesB;
+    std::vector<std::string> labelsA, labelsB;
+    if (!parseVariable(varA, valuesA, labelsA) || (verb == "joint" && !parseVariable(varB, valuesB, labelsB))) {
+      std::cout << "Error. Cannot parse variables of '" << body << "'" << std::endl;
+      return;
+    }
+    if (verb == "dist") {
+      valuesB.push_back(m_all);
+      labelsB.push_back("");
+    }
+    std::vector<std::pair<uint64_t, std::string>> rows;
+    bitmap cell(m_words);
+    for (size_t a = 0; a < valuesA.size(); ++a) {
+      for (size_t b = 0; b < valuesB.size(); ++b) {
+        for (size_t w = 0; w < m_words; ++w) cell[w] = valuesA[a][w] & valuesB[b][w] & condition[w];
+        rows.push_back(std::make_pair(count(cell), labelsA[a] + (labelsB[b].empty() ? "" : " / " + labelsB[b])));
+      }
+    }
+    printTable(rows, nCondition);
+    return;
+  }
+
+  bitmap selected;
+  if (!parseConjunction(body, selected)) return;
+  andInto(selected, condition);
+  const uint64_t n = count(selected);
+  const double p = (nCondition ? n / (double)nCondition : 0.);
+  std::cout << "  " << n << " / " << nCondition << " trials, P = " << std::setprecision(5) << p
+    << " +- " << (nCondition ? std::sqrt(p * (1. - p) / nCondition) : 0.) << std::endl;
+}
@@ -0,0 +1,51 @@
+#ifndef WCMC_TRIALQUERY_H
+#define WCMC_TRIALQUERY_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "trialStore.h"
+
+// Conjunctive queries over a trialStore, answered with per-(team, stage) and per-(match, team) bitmaps.
+// Bitmaps are built lazily from the mapped columns the first time a term needs them.
+//
+//   Brazil@SF                 Team reaches a stage: R16, QF, SF, F (plays the final) or W (wins)
+//   M64=AR                    Winner of FIFA match 64 (group games are M1-M48 in doGroup order)
+//   goals>150                 Total goals in the trial (also <)
+//   !term                     Negation
+//   A & B | C & D             P(A & B) given C & D
+//   dist M64 [| cond]         Distribution of a match winner, or of the furthest stage of a team
+//   joint M61 M62 [| cond]    Joint distribution of two such variables
+
+enum Stage {kStageR16, kStageQuarter, kStageSemi, kStageFinal, kStageWinner, kStages};
+
+typedef std::vector<uint64_t> bitmap;
+
+class trialQuery {
+public:
+  trialQuery(const trialReader& store);
+
+  void run(const std::string& query);
+  uint64_t count(const bitmap& b) const;
+
+  const bitmap& teamStage(const int team, const Stage stage);
+  const bitmap& matchWinner(const int match, const int team);
+  bitmap totalGoals(const bool greater, const int k);
+
+private:
+  bool parseConjunction(const std::string& text, bitmap& result);
+  bool parseTerm(std::string term, bitmap& result);
+  bool parseVariable(const std::string& text, std::vector<bitmap>& values, std::vector<std::string>& labels);
+  void printTable(const std::vector<std::pair<uint64_t, std::string>>& rows, const uint64_t norm);
+
+  const trialReader& m_store;
+  size_t m_words;
+  bitmap m_all;
+  std::map<int, bitmap> m_teamStage;
+  std::map<int, bitmap> m_matchWinner;
+  std::vector<uint16_t> m_goals;
+};
+
+#endif // WCMC_TRIALQUERY_H
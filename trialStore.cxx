@@ -0,0 +1,133 @@
+#include "trialStore.h"
+
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char kStoreMagic[8] = {'W', 'C', 'M', 'C', 'T', 'R', 'L', 'S'};
+
+void trialRecord::clear() {
+  memset(goals, kSlotNotPlayed, sizeof(goals));
+  memset(winner, kSlotNotPlayed, sizeof(winner));
+  memset(loser, kSlotNotPlayed, sizeof(loser));
+}
+
+void trialRecord::setGoals(const int slot, const int goalsA, const int goalsB) {
+  goals[slot] = (std::min(goalsA, 15) << 4) | std::min(goalsB, 15);
+}
+
+void trialRecord::setKnockout(const int slot, const int winnerIndex, const int loserIndex, const bool awayWon) {
+  const int ko = slot - kGroupSlots;
+  winner[ko] = winnerIndex;
+  loser[ko] = loserIndex;
+  if (awayWon) goals[slot] = (goals[slot] << 4) | (goals[slot] >> 4); // Re-order as winner, loser
+}
+
+bool trialWriter::open(const std::string& fname, const trialStoreHeader& header) {
+  m_file = fopen(fname.c_str(), "wb");
+  if (m_file == nullptr) {
+    std::cout << "Error. Cannot open trial store " << fname << " for writing" << std::endl;
+    return false;
+  }
+  m_header = header;
+  memcpy(m_header.magic, kStoreMagic, sizeof(kStoreMagic));
+  m_header.version = kStoreVersion;
+  m_header.blockTrials = kStoreBlockTrials;
+  m_header.nTrials = 0;
+  m_fname = fname;
+  std::vector<uint8_t> page(kStoreHeaderBytes, 0);
+  memcpy(page.data(), &m_header, sizeof(m_header));
+  m_ok = (fwrite(page.data(), 1, page.size(), m_file) == page.size());
+  if (!m_ok) {
+    close();
+    return false;
+  }
+  m_block.assign((size_t)kStoreColumns * kStoreBlockTrials, kSlotNotPlayed);
+  m_inBlock = 0;
+  return true;
+}
+
+void trialWriter::append(const trialRecord& r) {
+  uint8_t* b = m_block.data() + m_inBlock;
+  for (int s = 0; s < kTrialSlots; ++s)    b[(size_t)s * kStoreBlockTrials] = r.goals[s];
+  for (int k = 0; k < kKnockoutSlots; ++k) b[(size_t)(kTrialSlots + k) * kStoreBlockTrials] = r.winner[k];
+  for (int k = 0; k < kKnockoutSlots; ++k) b[(size_t)(kTrialSlots + kKnockoutSlots + k) * kStoreBlockTrials] = r.loser[k];
+  ++m_header.nTrials;
+  if (++m_inBlock == kStoreBlockTrials) flushBlock();
+}
+
+void trialWriter::flushBlock() {
+  m_ok = m_ok && fwrite(m_block.data(), 1, m_block.size(), m_file) == m_block.size(); // One large sequential write per block
+  std::fill(m_block.begin(), m_block.end(), kSlotNotPlayed);
+  m_inBlock = 0;
+}
+
+bool trialWriter::close() {
+  if (m_file == nullptr) return true;
+  if (m_inBlock > 0) flushBlock(); // Final block is padded, nTrials says how much of it is valid
+  bool ok = m_ok && fseek(m_file, 0, SEEK_SET) == 0 && fwrite(&m_header, sizeof(m_header), 1, m_file) == 1;
+  ok = (fclose(m_file) == 0) && ok;
+  m_file = nullptr;
+  m_block.clear();
+  m_block.shrink_to_fit();
+  if (!ok) { // A truncated store would still claim every trial, so leave none
+    std::cout << "Error. Cannot write trial store " << m_fname << std::endl;
+    remove(m_fname.c_str());
+  }
+  return ok;
+}
+
+bool trialReader::open(const std::string& fname) {
+  close();
+  const int fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Error. Cannot open trial store " << fname << std::endl;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    std::cout << "Error. Cannot open trial store " << fname << std::endl;
+    return false;
+  }
+  m_size = st.st_size;
+  void* map = (m_size >= kStoreHeaderBytes ? mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    std::cout << "Error. Cannot map trial store " << fname << std::endl;
+    return false;
+  }
+  madvise(map, m_size, MADV_SEQUENTIAL);
+  m_data = static_cast<const uint8_t*>(map);
+  m_header = reinterpret_cast<const trialStoreHeader*>(m_data);
+  const bool valid = (memcmp(m_header->magic, kStoreMagic, sizeof(kStoreMagic)) == 0 && m_header->version == kStoreVersion && m_header->blockTrials > 0 && m_header->nTeams <= (uint32_t)kStoreMaxTeams);
+  if (!valid || m_size < kStoreHeaderBytes + (blocks() * kStoreColumns * (size_t)m_header->blockTrials)) {
+    std::cout << "Error. " << fname << " is not a valid trial store" << std::endl;
+    close();
+    return false;
+  }
+  return true;
+}
+
+void trialReader::close() {
+  if (m_data != nullptr) munmap(const_cast<uint8_t*>(m_data), m_size);
+  m_data = nullptr;
+  m_header = nullptr;
+  m_size = 0;
+}
+
+int trialReader::trialsInBlock(const uint64_t block) const {
+  const uint64_t first = block * m_header->blockTrials;
+  return (int) std::min<uint64_t>(m_header->blockTrials, m_header->nTrials - first);
+}
+
+int trialReader::findTeam(const std::string& nameOrAbbreviation) const {
+  for (uint32_t t = 0; t < m_header->nTeams; ++t) {
+    if (nameOrAbbreviation == m_header->teamName[t] || nameOrAbbreviation == m_header->teamAbbreviation[t]) return t;
+  }
+  return -1;
+}
@@ -0,0 +1,98 @@
+#ifndef WCMC_TRIALSTORE_H
+#define WCMC_TRIALSTORE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Columnar store of every simulated tournament.
+// The file is a 4 kB header followed by fixed size blocks of kStoreBlockTrials trials. Inside a block each
+// column is contiguous: 64 goal columns (one per match slot) then 16 winner and 16 loser columns for the knockout.
+// Slots 0-47 are the group games (group-major, in doGroup order), slots 48-63 are FIFA matches 49-64.
+
+const int kGroupSlots = 48;
+const int kKnockoutSlots = 16;
+const int kTrialSlots = kGroupSlots + kKnockoutSlots;
+const int kStoreColumns = kTrialSlots + 2 * kKnockoutSlots;
+const int kStoreMaxTeams = 32;
+const int kStoreBlockTrials = 1 << 16;
+const uint32_t kStoreVersion = 1;
+const uint8_t kSlotNotPlayed = 0xFF; // Slot not simulated in this Mode
+
+struct trialRecord {
+  uint8_t goals[kTrialSlots]; // (goalsA << 4) | goalsB saturating at 15. Knockout slots are ordered winner, loser
+  uint8_t winner[kKnockoutSlots];
+  uint8_t loser[kKnockoutSlots];
+
+  void clear();
+  void setGoals(const int slot, const int goalsA, const int goalsB);
+  void setKnockout(const int slot, const int winnerIndex, const int loserIndex, const bool awayWon);
+};
+
+struct trialStoreHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t mode;
+  uint32_t nTeams;
+  uint32_t blockTrials;
+  uint64_t nTrials;
+  char teamName[kStoreMaxTeams][24];
+  char teamAbbreviation[kStoreMaxTeams][4];
+  uint8_t fixtureA[kGroupSlots]; // Team indices of the group games, kSlotNotPlayed after the group stage
+  uint8_t fixtureB[kGroupSlots];
+};
+
+const size_t kStoreHeaderBytes = 4096;
+
+class trialWriter {
+public:
+  trialWriter() : m_file(nullptr), m_inBlock(0), m_ok(false) {}
+  ~trialWriter() { close(); }
+
+  bool open(const std::string& fname, const trialStoreHeader& header);
+  void append(const trialRecord& r);
+  bool close(); // False, and the file removed, if any write failed
+  uint64_t trials() const { return m_header.nTrials; }
+
+private:
+  void flushBlock();
+
+  FILE* m_file;
+  std::string m_fname;
+  trialStoreHeader m_header;
+  std::vector<uint8_t> m_block;
+  int m_inBlock;
+  bool m_ok; // Every write so far succeeded
+};
+
+class trialReader {
+public:
+  trialReader() : m_data(nullptr), m_size(0), m_header(nullptr) {}
+  ~trialReader() { close(); }
+
+  bool open(const std::string& fname);
+  void close();
+
+  const trialStoreHeader& header() const { return *m_header; }
+  uint64_t trials() const { return m_header->nTrials; }
+  uint64_t blocks() const { return (m_header->nTrials + m_header->blockTrials - 1) / m_header->blockTrials; }
+  int trialsInBlock(const uint64_t block) const;
+  int findTeam(const std::string& nameOrAbbreviation) const;
+
+  // Zero-copy views of one column within one block
+  const uint8_t* goals(const uint64_t block, const int slot) const  { return column(block, slot); }
+  const uint8_t* winner(const uint64_t block, const int ko) const   { return column(block, kTrialSlots + ko); }
+  const uint8_t* loser(const uint64_t block, const int ko) const    { return column(block, kTrialSlots + kKnockoutSlots + ko); }
+
+private:
+  const uint8_t* column(const uint64_t block, const int column) const {
+    return m_data + kStoreHeaderBytes + ((block * kStoreColumns) + column) * m_header->blockTrials;
+  }
+
+  const uint8_t* m_data;
+  size_t m_size;
+  const trialStoreHeader* m_header;
+};
+
+#endif // WCMC_TRIALSTORE_H
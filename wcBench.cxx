@@ -0,0 +1,316 @@
+// Microbenchmarks of the simulation hot paths
+//   make wcBench.exe
+//   ./wcBench.exe [--out bench_results.csv] [--baseline old_bench_results.csv]
+// Every result is a median time per operation, so lower is better.
+//   make clean && make PROFILE=1 wcBench.exe && ./wcBench.exe --check-allocations
+// Fails if a trial allocates once its outcomes and histograms exist.
+//   ./wcBench.exe --check-counts
+// Fails unless 3e9 fills of one bin are counted exactly.
+//   ./wcBench.exe --check-threads
+// Fails unless the trials of one run, split over threads and added up, give exactly the same results.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <TError.h>
+#include <TH1D.h>
+#include <TH2D.h>
+#include "profile.h"
+#include "logger.h"
+#include "wcEngine.h"
+#include "toyBets.h"
+
+const int kRepeats = 5;
+const double kBenchTolerance = 0.10; // Slow down before a result counts as a regression
+const float kBenchLow = 1.53, kBenchHigh = 1.54;
+const int kAllocationTrials = 2000; // Played twice, the replay must not allocate
+const uint64_t kCountFills = 3000000000ull; // Past 2^31 and far past the 2^24 a float bin counts to
+const uint64_t kThreadTrials = 20000;
+
+struct benchResult {
+  std::string name;
+  std::string unit;
+  double value;
+  long iterations;
+};
+
+class quietOutput { // Drop std::cout while the simulation is being exercised
+public:
+  quietOutput() : m_old(std::cout.rdbuf(nullptr)) {}
+  ~quietOutput() { std::cout.rdbuf(m_old); std::cout.clear(); }
+private:
+  std::streambuf* m_old;
+};
+
+// Median of kRepeats timings of fn(iterations) after a warm up, in ns per iteration
+template <typename F>
+double timeIt(F fn, const long iterations) {
+  fn(std::max(iterations / 10, 1l));
+  std::vector<double> ns;
+  for (int r = 0; r < kRepeats; ++r) {
+    const auto start = std::chrono::steady_clock::now();
+    fn(iterations);
+    ns.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations);
+  }
+  std::sort(ns.begin(), ns.end());
+  return ns.at(kRepeats / 2);
+}
+
+tournamentConfig* makeConfig(const Mode mode) {
+  quietOutput quiet;
+  tournamentConfig* config = new tournamentConfig();
+  config->load(2022, mode);
+  return config;
+}
+
+std::vector<double> loadOdds() {
+  std::vector<double> oddsVec;
+  std::ifstream odds("wc_2018_odds.txt");
+  std::string line;
+  while ( getline(odds, line) ) {
+    std::istringstream ss(line);
+    std::string first;
+    if (!(ss >> first) || first == "#") continue;
+    if (first == "##") break;
+    oddsVec.push_back( std::stod(first) );
+  }
+  return oddsVec;
+}
+
+void runBenchmarks(std::vector<benchResult>& results) {
+  tournamentConfig* config = makeConfig(kFULL_TOURNAMENT);
+  tournamentRun run(*config);
+  run.random().setSeed(1);
+
+  results.push_back({"doMatch", "ns/match", timeIt([&](long n) {
+    for (long i = 0; i < n; ++i) run.playMatch(0, 1, kBenchLow, kBenchHigh, 0);
+  }, 1000000), 1000000});
+
+  results.push_back({"doGroup", "ns/group", timeIt([&](long n) {
+    for (long i = 0; i < n; ++i) run.playGroup(0, kBenchLow, kBenchHigh);
+  }, 200000), 200000});
+
+  volatile int winner = 0; // Keeps the calls from being optimised away
+  results.push_back({"getWinningTeam", "ns/call", timeIt([&](long n) {
+    for (long i = 0; i < n; ++i) winner = run.groupWinner(0);
+  }, 1000000), 1000000});
+
+  for (int m = kFULL_TOURNAMENT; m <= kAFTER_SEMI; ++m) {
+    tournamentConfig* configMode = makeConfig((Mode) m);
+    tournamentRun runMode(*configMode);
+    results.push_back({"runTrial_Mode" + std::to_string(m), "ns/trial", timeIt([&](long n) {
+      for (long i = 0; i < n; ++i) runMode.playTrial(i, kBenchLow, kBenchHigh);
+    }, 20000), 20000});
+    delete configMode;
+  }
+
+  tournamentRun outcomes(*config);
+  outcomes.simulate(0, 1000, kBenchLow, kBenchHigh); // Realistic spread of keys for the maps
+  results.push_back({"recordOutcome", "ns/trial", timeIt([&](long n) {
+    for (long i = 0; i < n; ++i) outcomes.recordOutcome();
+  }, 200000), 200000});
+
+  {
+    quietOutput quiet;
+    tuningResult tuning;
+    results.push_back({"runTraining_point", "ns/point", timeIt([&](long n) {
+      for (long i = 0; i < n; ++i) tune(*config, tuningGrid{1.5, 1.55, 1.6, 1.55, /*step*/0.1, 10000 * 10}, tuning);
+    }, 1), 1});
+  }
+
+  const std::vector<double> oddsVec = loadOdds();
+  const toyOdds toy(oddsVec, 0.2);
+  TRandom3 R(1);
+  toyCounts counts;
+  std::vector<double> u;
+  results.push_back({"toyBets_round", "ns/round", timeIt([&](long n) {
+    playRounds(R, toy, n, counts, u);
+  }, 1000000), 1000000});
+
+  // Thread scaling of the group stage, the threads share the config and each owns a run and does a fixed amount of work
+  const unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  const long groupsPerThread = 100000;
+  std::vector<tournamentRun*> runs;
+  for (unsigned t = 0; t < maxThreads; ++t) runs.push_back(new tournamentRun(*config));
+  std::vector<unsigned> sweep; // Powers of two below the core count, then every core
+  for (unsigned nThreads = 1; nThreads < maxThreads; nThreads *= 2) sweep.push_back(nThreads);
+  sweep.push_back(maxThreads);
+  for (const unsigned nThreads : sweep) {
+    const double ns = timeIt([&](long n) {
+      std::vector<std::thread> threads;
+      for (unsigned t = 0; t < nThreads; ++t) {
+        threads.emplace_back([&, t]() { for (long i = 0; i < n; ++i) runs.at(t)->playGroup(0, kBenchLow, kBenchHigh); });
+      }
+      for (std::thread& thread : threads) thread.join();
+    }, groupsPerThread);
+    results.push_back({"doGroup_threads" + std::to_string(nThreads), "ns/group", ns / nThreads, groupsPerThread * nThreads});
+  }
+  for (tournamentRun* r : runs) delete r;
+  delete config;
+}
+
+// Play trials to create every outcome key and score matrix they need, then replay the same seeds with allocations counted by profile.cxx
+bool checkAllocations() {
+#ifdef WCMC_PROFILE
+  bool ok = true;
+  for (int m = kFULL_TOURNAMENT; m <= kAFTER_SEMI; ++m) {
+    tournamentConfig* config = makeConfig((Mode) m);
+    tournamentRun run(*config); // All the bookkeeping of runFinal
+    uint64_t allocations = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+      const uint64_t before = g_profileAllocations.load();
+      for (int trial = 0; trial < kAllocationTrials; ++trial) {
+        run.playTrial(trial, kBenchLow, kBenchHigh);
+        run.recordOutcome();
+      }
+      allocations = g_profileAllocations.load() - before;
+    }
+    std::cout << "Mode " << m << ": " << allocations << " allocations in " << kAllocationTrials << " trials after warm up" << std::endl;
+    ok &= (allocations == 0);
+    delete config;
+  }
+  std::cout << (ok ? "Allocations OK" : "Trial loop ALLOCATES") << std::endl;
+  return ok;
+#else
+  std::cout << "Error. Allocations are only counted when built with -DWCMC_PROFILE" << std::endl;
+  return false;
+#endif
+}
+
+// One bin of a round histogram and one cell of a score matrix, filled as the simulation does and copied for output
+bool checkCounts() {
+  binCounts round(32, 0, 32), score(8, -.5, 7.5, 8, -.5, 7.5);
+  for (uint64_t i = 0; i < kCountFills; ++i) {
+    round.fill(3.5);
+    score.fill2(2, 1);
+  }
+  TH1D hRound("checkRound", "", 32, 0, 32);
+  TH2D hScore("checkScore", "", 8, -.5, 7.5, 8, -.5, 7.5);
+  round.copyTo(&hRound);
+  score.copyTo(&hScore);
+  const int cell = 2 * 10 + 3; // Bin (3, 2) of the 10 x 10 cells
+  const bool ok = (round.count(4) == kCountFills && round.entries() == kCountFills && score.count(cell) == kCountFills
+    && hRound.GetBinContent(4) == (double) kCountFills && hScore.GetBinContent(cell) == (double) kCountFills);
+  std::cout << kCountFills << " fills counted " << round.count(4) << " and " << score.count(cell) << ", histograms "
+    << std::setprecision(12) << hRound.GetBinContent(4) << " and " << hScore.GetBinContent(cell) << std::endl;
+  std::cout << (ok ? "Counts OK" : "Counts INEXACT") << std::endl;
+  return ok;
+}
+
+bool sameCounts(const binCounts& a, const binCounts& b) {
+  if (a.cells() != b.cells() || a.entries() != b.entries()) return false;
+  for (int i = 0; i < a.cells(); ++i) if (a.count(i) != b.count(i)) return false;
+  return true;
+}
+
+// Every Mode played as one run, then as one run per thread over a share of the trials each
+bool checkThreads() {
+  const int nThreads = std::max(std::min(std::thread::hardware_concurrency(), 8u), 2u);
+  bool ok = true;
+  for (int m = kFULL_TOURNAMENT; m <= kAFTER_SEMI; ++m) {
+    tournamentConfig* config = makeConfig((Mode) m);
+    tournamentRun single(*config);
+    single.simulate(0, kThreadTrials, kBenchLow, kBenchHigh);
+
+    std::vector<tournamentRun*> runs;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; ++t) runs.push_back(new tournamentRun(*config));
+    for (int t = 0; t < nThreads; ++t) {
+      threads.emplace_back([&, t]() { runs.at(t)->simulate(kThreadTrials * t / nThreads, kThreadTrials * (t + 1) / nThreads, kBenchLow, kBenchHigh); });
+    }
+    for (std::thread& thread : threads) thread.join();
+    simulationResults merged;
+    merged.init(*config);
+    for (tournamentRun* run : runs) merged.add(run->results());
+
+    const simulationResults& expected = single.results();
+    bool same = (merged.trials == expected.trials && merged.outcomes == expected.outcomes && merged.outcomesToQuarter == expected.outcomesToQuarter
+      && merged.outcomesToSemi == expected.outcomesToSemi && sameCounts(merged.goals, expected.goals) && sameCounts(merged.goalDiff, expected.goalDiff));
+    for (int i = 0; i < 6; ++i) same &= sameCounts(merged.stages[i], expected.stages[i]);
+    for (size_t i = 0; i < expected.groupPositions.size(); ++i) same &= sameCounts(merged.groupPositions[i], expected.groupPositions[i]);
+    for (size_t i = 0; i < expected.scores.size(); ++i) same &= sameCounts(merged.scores[i], expected.scores[i]);
+    std::cout << "Mode " << m << ": " << kThreadTrials << " trials on " << nThreads << " threads " << (same ? "match" : "DIFFER") << std::endl;
+    ok &= same;
+    for (tournamentRun* run : runs) delete run;
+    delete config;
+  }
+  std::cout << (ok ? "Threads OK" : "Threads DIFFER") << std::endl;
+  return ok;
+}
+
+bool writeResults(const std::string& fname, const std::vector<benchResult>& results) {
+  std::ofstream out(fname);
+  if (!out) {
+    std::cout << "Error. Cannot write benchmark results to " << fname << std::endl;
+    return false;
+  }
+  out << "name,unit,value,iterations" << std::endl;
+  for (const benchResult& r : results) out << r.name << "," << r.unit << "," << std::setprecision(6) << r.value << "," << r.iterations << std::endl;
+  return true;
+}
+
+bool compareResults(const std::vector<benchResult>& results, const std::string& baseline) {
+  std::ifstream in(baseline);
+  std::map<std::string, double> before;
+  std::string line;
+  while ( getline(in, line) ) {
+    std::vector<std::string> fields;
+    std::istringstream ss(line);
+    std::string field;
+    while ( getline(ss, field, ',') ) fields.push_back(field);
+    if (fields.size() == 4 && fields[0] != "name") before[fields[0]] = std::stod(fields[2]);
+  }
+  if (before.empty()) {
+    std::cout << "Error. No results in baseline " << baseline << std::endl;
+    return false;
+  }
+  bool regressed = false;
+  std::cout << "Comparison to " << baseline << std::endl;
+  for (const benchResult& r : results) {
+    std::map<std::string, double>::const_iterator it = before.find(r.name);
+    if (it == before.end()) continue;
+    const bool slower = (r.value > it->second * (1. + kBenchTolerance));
+    regressed |= slower;
+    std::cout << "  " << std::setw(22) << std::left << r.name << std::right << std::setw(14) << it->second << " -> " << std::setw(14) << r.value
+      << "  x" << std::setprecision(3) << r.value / it->second << std::setprecision(6) << (slower ? "  REGRESSION" : "") << std::endl;
+  }
+  std::cout << (regressed ? "Performance REGRESSED" : "Performance OK") << std::endl;
+  return !regressed;
+}
+
+int main(int argc, char* argv[]) {
+  std::string out = "bench_results.csv", baseline;
+  bool allocations = false, counts = false, threads = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if      (arg == "--out" && i + 1 < argc)      out = argv[++i];
+    else if (arg == "--baseline" && i + 1 < argc) baseline = argv[++i];
+    else if (arg == "--check-allocations")        allocations = true;
+    else if (arg == "--check-counts")             counts = true;
+    else if (arg == "--check-threads")            threads = true;
+    else {
+      std::cout << "Usage: wcBench.exe [--out bench_results.csv] [--baseline old_bench_results.csv] [--check-allocations] [--check-counts] [--check-threads]" << std::endl;
+      return 1;
+    }
+  }
+  gErrorIgnoreLevel = 10000;
+  logger::get().setLevel(kLogError); // Progress messages bypass quietOutput
+  if (allocations || counts || threads) {
+    return ((!allocations || checkAllocations()) && (!counts || checkCounts()) && (!threads || checkThreads()) ? 0 : 1);
+  }
+
+  std::vector<benchResult> results;
+  runBenchmarks(results);
+  for (const benchResult& r : results) {
+    std::cout << std::setw(22) << std::left << r.name << std::right << std::setw(14) << r.value << " " << r.unit << std::endl;
+  }
+  if (!writeResults(out, results)) return 1;
+  if (!baseline.empty() && !compareResults(results, baseline)) return 1;
+  return 0;
+}
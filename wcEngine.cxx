@@ -0,0 +1,680 @@
+#include "wcEngine.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include "logger.h"
+#include "profile.h"
+
+void wcRandom::generate() {
+  const int kM = 397;
+  const uint32_t kUpper = 0x80000000u, kLower = 0x7fffffffu, kMatrixA = 0x9908b0dfu;
+  uint32_t y;
+  int i = 0;
+  for (; i < kN - kM; ++i) {
+    y = (m_mt[i] & kUpper) | (m_mt[i + 1] & kLower);
+    m_mt[i] = m_mt[i + kM] ^ (y >> 1) ^ ((y & 1) ? kMatrixA : 0);
+  }
+  for (; i < kN - 1; ++i) {
+    y = (m_mt[i] & kUpper) | (m_mt[i + 1] & kLower);
+    m_mt[i] = m_mt[i + kM - kN] ^ (y >> 1) ^ ((y & 1) ? kMatrixA : 0);
+  }
+  y = (m_mt[kN - 1] & kUpper) | (m_mt[0] & kLower);
+  m_mt[kN - 1] = m_mt[kM - 1] ^ (y >> 1) ^ ((y & 1) ? kMatrixA : 0);
+  m_count = 0;
+}
+
+// Rejection from a Lorentzian, as TRandom::Poisson below 1e9. Team goal expectations never get here
+int wcRandom::poissonLarge(const double mean) {
+  const double sq = std::sqrt(2. * mean), alxm = std::log(mean), g = mean * alxm - std::lgamma(mean + 1.);
+  double em, t, y;
+  do {
+    do {
+      y = std::tan(M_PI * rndm());
+      em = sq * y + mean;
+    } while (em < 0.);
+    em = std::floor(em);
+    t = 0.9 * (1. + y * y) * std::exp(em * alxm - std::lgamma(em + 1.) - g);
+  } while (rndm() > t);
+  return (int) em;
+}
+
+std::string tournamentConfig::dataFile(const std::string& what, const int year) const {
+  return "wc_" + std::to_string(year ? year : m_year) + "_" + what + ".txt";
+}
+
+std::vector<std::string> tournamentConfig::readLine(const std::string& line) {
+  std::istringstream buf(line);
+  std::istream_iterator<std::string> beg(buf), end;
+  std::vector<std::string> results(beg, end);
+  for (size_t i = 0; i < results.size(); ++i) {
+    size_t location = results[i].find("-");
+    if (location != std::string::npos) results[i].replace(location, 1, " ");
+  }
+  return results;
+}
+
+int tournamentConfig::teamIndex(const std::string& name) const {
+  for (size_t t = 0; t < m_teams.size(); ++t) {
+    if (m_teams[t].name == name) return t;
+  }
+  return -1;
+}
+
+int tournamentConfig::groupIndex(const std::string& letter) const {
+  const std::vector<std::string>::const_iterator it = std::find(m_groupLetters.begin(), m_groupLetters.end(), letter);
+  return (it == m_groupLetters.end() ? -1 : std::distance(m_groupLetters.begin(), it));
+}
+
+bool tournamentConfig::load(const int year, const Mode mode, const std::string& historic, const historicFilter& selection) {
+  m_year = year;
+  m_mode = mode;
+  m_teams.clear();
+  m_groupLetters.clear();
+  m_groups.clear();
+  m_advance.clear();
+  m_laterRoundTeams.clear();
+  for (std::vector<int>& seeds : m_seeds) seeds.clear();
+  m_trainingLabel.clear();
+
+  std::cout << "Loading Historic" << std::endl;
+  loadHistoricData(historic, selection);
+  std::cout << "Loading Teams" << std::endl;
+  if (!loadTeams()) return false;
+  if (m_mode == kFULL_TOURNAMENT) {
+    std::cout << "Loading Groups" << std::endl;
+    if (!loadGroups()) return false;
+  }
+  return true;
+}
+
+void tournamentConfig::addHistoric(const int goalsA, const int goalsB, const int year) {
+  if (year < m_year) {
+    m_goalDiffTraining.fill(abs( goalsA - goalsB ));
+    m_goalsTraining.fill(goalsA + goalsB);
+  } else if (year == m_year) {
+    m_goalDiffTest.fill(abs( goalsA - goalsB ));
+    m_goalsTest.fill(goalsA + goalsB);
+  }
+}
+
+void tournamentConfig::loadHistoricData(const std::string& historic, const historicFilter& selection) { // Earlier tournaments are for training, this one (if played) for testing
+  for (binCounts* counts : {&m_goalsTraining, &m_goalDiffTraining, &m_goalsTest, &m_goalDiffTest}) *counts = binCounts(9, -0.5, 8.5);
+  std::string line;
+  const bool matchDatabase = !historic.empty() && loadHistoricMatches(historic, selection);
+  for (int year = (matchDatabase ? m_year : 1930); year <= m_year; year += 4) {
+    std::ifstream results(dataFile("results", year));
+    if (!results) continue;
+    if (year < m_year) m_trainingLabel += (m_trainingLabel.empty() ? "" : "+") + std::to_string(year % 100);
+    while ( getline(results, line) ) {
+      std::vector<std::string> goals = readLine(line);
+      if (goals.size() < 2) continue;
+      addHistoric(std::stoi(goals[0]), std::stoi(goals[1]), year);
+    }
+  }
+}
+
+// Training data from a large match database, see historicMatches.h
+bool tournamentConfig::loadHistoricMatches(const std::string& historic, const historicFilter& selection) {
+  historicMatches matches;
+  if (!matches.load(historic)) return false;
+  historicFilter filter = selection;
+  if (filter.to == historicFilter().to) filter.to = m_year * 10000; // Up to the end of last year
+  const std::vector<uint32_t> selected = matches.select(filter);
+  if (selected.empty()) {
+    std::cout << "Error. No historic matches selected from " << historic << std::endl;
+    return false;
+  }
+  std::vector<long> goals, goalDiff;
+  matches.countGoals(selected, goals, goalDiff);
+  for (int i = 0; i <= kHistoricMaxGoals; ++i) {
+    for (long n = 0; n < goals[i]; ++n) m_goalsTraining.fill(i);
+    for (long n = 0; n < goalDiff[i]; ++n) m_goalDiffTraining.fill(i);
+  }
+  m_trainingLabel = std::to_string(selected.size()) + " games";
+  std::cout << "Training on " << selected.size() << " of " << matches.size() << " historic matches" << std::endl;
+  return true;
+}
+
+bool tournamentConfig::loadTeams() {
+  static const char* const kPassFiles[5] = {"", "pass_groups", "pass_16", "pass_quarter", "pass_semi"};
+  static const size_t kPassing[5] = {0, 16, 8, 4, 4}; // pass_semi also lists the losing semi finalists
+  std::string line;
+  std::vector<std::string> passed;
+  if (m_mode > kFULL_TOURNAMENT) {
+    std::ifstream pass(dataFile(kPassFiles[m_mode]));
+    while ( getline(pass, line) ) {
+      std::vector<std::string> results = readLine(line);
+      if (results.empty()) continue;
+      passed.push_back( results[0] );
+      LOG_DEBUG("Passed stage {}: '{}'", (int)m_mode, results[0]);
+    }
+    if (passed.size() < kPassing[m_mode]) {
+      std::cout << "Error. " << dataFile(kPassFiles[m_mode]) << " lists " << passed.size() << " teams, expected " << kPassing[m_mode] << std::endl;
+      return false;
+    }
+  }
+
+  std::ifstream teams(dataFile("team_ranks"));
+  m_totalTeams = 0;
+  while ( getline(teams, line) ) {
+    std::vector<std::string> results = readLine(line);
+    if (results.size() < 2) continue;
+    if (m_mode == kFULL_TOURNAMENT || std::count(passed.begin(), passed.end(), results[0]) != 0)  {
+      m_teams.push_back({results[0], results[1], /*rank ==*/ m_totalTeams});
+      LOG_DEBUG("Team {} ({}) Rank:{} Index:{}", results[0], results[1], m_totalTeams, (int)m_teams.size() - 1);
+    } else LOG_DEBUG("  Dropping team: '{}'", results[0]);
+    ++m_totalTeams;
+  }
+  logger::get().flush(); // Before anything else is printed
+  if (m_teams.empty()) {
+    std::cout << "Error. No teams loaded from " << dataFile("team_ranks") << std::endl;
+    return false;
+  }
+
+  for (const std::string& name : passed) {
+    const int index = teamIndex(name);
+    if (index < 0) {
+      std::cout << "Error. " << name << " from " << dataFile(kPassFiles[m_mode]) << " is not in " << dataFile("team_ranks") << std::endl;
+      return false;
+    }
+    m_laterRoundTeams.push_back(index);
+  }
+  seedKnockout();
+  return true;
+}
+
+// The pass file lists the teams in the order of the matches they play next
+void tournamentConfig::seedKnockout() {
+  static const int kRoundOf16[16] = {49, 51, 51, 49, 50, 52, 52, 50, 53, 55, 55, 53, 54, 56, 56, 54};
+  static const int kQuarterFinals[8] = {57, 57, 59, 59, 58, 58, 60, 60};
+  static const int kSemiFinals[4] = {61, 61, 62, 62};
+  static const int kFinals[4] = {64, 64, 63, 63}; // The finalists, then the losing semi finalists
+  const int* matches = nullptr;
+  size_t n = 0;
+  switch (m_mode) {
+    case kFULL_TOURNAMENT: return;
+    case kAFTER_GROUP:   matches = kRoundOf16; n = 16; break;
+    case kAFTER_16:      matches = kQuarterFinals; n = 8; break;
+    case kAFTER_QUARTER: matches = kSemiFinals; n = 4; break;
+    case kAFTER_SEMI:    matches = kFinals; n = 4; break;
+  }
+  for (size_t t = 0; t < m_laterRoundTeams.size() && t < n; ++t) m_seeds[matches[t] - kFirstKnockoutMatch].push_back(m_laterRoundTeams[t]);
+}
+
+bool tournamentConfig::loadGroups() {
+  // Round of 16 matches of the group winner and runner up
+  static const std::map<std::string, std::pair<int, int>> kAdvance = {{"A", {49, 51}}, {"B", {51, 49}}, {"C", {50, 52}}, {"D", {52, 50}},
+    {"E", {53, 55}}, {"F", {55, 53}}, {"G", {54, 56}}, {"H", {56, 54}}};
+  std::ifstream groups(dataFile("groups"));
+  std::string line;
+  while ( getline(groups, line) ) {
+    std::vector<std::string> r = readLine(line);
+    if (r.empty()) continue;
+    if (r.size() != 1 + kTeamsPerGroup) {
+      std::cout << "Error. Group " << r[0] << " in " << dataFile("groups") << " does not have " << kTeamsPerGroup << " teams" << std::endl;
+      return false;
+    }
+    std::vector<int> teams;
+    for (int t = 1; t <= kTeamsPerGroup; ++t) {
+      teams.push_back(teamIndex(r[t]));
+      if (teams.back() < 0) {
+        std::cout << "Error. " << r[t] << " in group " << r[0] << " is not in " << dataFile("team_ranks") << std::endl;
+        return false;
+      }
+    }
+    const std::map<std::string, std::pair<int, int>>::const_iterator advance = kAdvance.find(r[0]);
+    m_groupLetters.push_back(r[0]);
+    m_groups.push_back(teams);
+    m_advance.push_back({advance == kAdvance.end() ? 0 : advance->second.first, advance == kAdvance.end() ? 0 : advance->second.second});
+  }
+  if (m_groups.empty()) {
+    std::cout << "Error. No groups loaded from " << dataFile("groups") << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void simulationResults::init(const tournamentConfig& config) {
+  nTeams = config.nTeams();
+  trials = 0;
+  goals = binCounts(9, -0.5, 8.5);
+  goalDiff = binCounts(9, -0.5, 8.5);
+  for (binCounts& stage : stages) stage = binCounts(nTeams, 0, nTeams);
+  groupPositions.assign(config.nGroups() * kTeamsPerGroup, binCounts(4, -.5, 3.5));
+  scores.assign(nTeams * nTeams, binCounts());
+  outcomes.clear();
+  outcomesToQuarter.clear();
+  outcomesToSemi.clear();
+}
+
+void simulationResults::reset() {
+  trials = 0;
+  goals.reset();
+  goalDiff.reset();
+  for (binCounts& stage : stages) stage.reset();
+  for (binCounts& position : groupPositions) position.reset();
+  scores.assign(scores.size(), binCounts());
+  outcomes.clear();
+  outcomesToQuarter.clear();
+  outcomesToSemi.clear();
+}
+
+void simulationResults::add(const simulationResults& other) {
+  trials += other.trials;
+  goals.add(other.goals);
+  goalDiff.add(other.goalDiff);
+  for (int i = 0; i < 6; ++i) stages[i].add(other.stages[i]);
+  for (size_t i = 0; i < groupPositions.size() && i < other.groupPositions.size(); ++i) groupPositions[i].add(other.groupPositions[i]);
+  for (size_t i = 0; i < scores.size() && i < other.scores.size(); ++i) {
+    if (other.scores[i].cells() == 0) continue;
+    if (scores[i].cells() == 0) scores[i] = other.scores[i];
+    else scores[i].add(other.scores[i]);
+  }
+  for (const auto& [key, n] : other.outcomes) outcomes[key] += n;
+  for (const auto& [key, n] : other.outcomesToQuarter) outcomesToQuarter[key] += n;
+  for (const auto& [key, n] : other.outcomesToSemi) outcomesToSemi[key] += n;
+}
+
+binCounts& simulationResults::score(const int teamA, const int teamB) {
+  binCounts& counts = scores[teamA * nTeams + teamB];
+  if (counts.cells() == 0) counts = binCounts(8, -.5, 7.5, 8, -.5, 7.5);
+  return counts;
+}
+
+double simulationResults::stageProbability(const int team, const int stage) const {
+  return (trials > 0 ? stages[stage].count(team + 1) / (double) trials : 0);
+}
+
+tournamentRun::tournamentRun(const tournamentConfig& config) : m_config(config), m_teams(config.nTeams()), m_record(nullptr) {
+  m_results.init(config);
+  size_t longestAbbreviation = 0;
+  for (int t = 0; t < config.nTeams(); ++t) longestAbbreviation = std::max(longestAbbreviation, config.team(t).abbreviation.size());
+  m_outcomeKey.reserve(16 * (longestAbbreviation + 1)); // W/2nd/SFs/QFs/R16s
+  resetTeams(true);
+  for (fixture& f : m_knockout) f.n = 0;
+}
+
+template <bool kStats, bool kPrint, bool kGoals>
+void tournamentRun::playMatchT(const int a, const int b, const float low, const float high, const int slot) {
+  const int totalTeams = m_config.totalTeams();
+  const float reduction = totalTeams / high;
+
+  float scoreA = low + ((totalTeams - m_config.team(a).rank) / reduction);
+  float scoreB = low + ((totalTeams - m_config.team(b).rank) / reduction);
+  int draws = 0;
+  while ( scoreA > low && scoreB > low) {
+    scoreA -= m_random.rndm() * low;
+    scoreB -= m_random.rndm() * low;
+    draws += 2;
+  }
+
+  const int goalsA = m_random.poisson(scoreA);
+  const int goalsB = m_random.poisson(scoreB);
+  PROFILE_COUNT("RNG draws per match", draws + goalsA + goalsB + 2); // Poisson with mean < 25 draws goals + 1 uniforms
+
+  m_results.goals.fill(goalsA + goalsB);
+  m_results.goalDiff.fill( abs(goalsA - goalsB) );
+
+  teamState& A = m_teams[a];
+  teamState& B = m_teams[b];
+  if (goalsA > goalsB) {
+    A.points += 3;
+  } else if (goalsB > goalsA) {
+    B.points += 3;
+  } else {
+    A.points += 1;
+    B.points += 1;
+  }
+
+  A.goals += goalsA;
+  B.goals += goalsB;
+  A.goalDiff += goalsA - goalsB;
+  B.goalDiff += goalsB - goalsA;
+
+  if constexpr (kPrint) std::cout << m_config.team(a).name << ":" << goalsA << " - " << m_config.team(b).name << ":" << goalsB << " | ";
+  if constexpr (kStats) {
+    PROFILE_SCOPE("recordStats");
+    m_results.score(a, b).fill2(goalsA, goalsB);
+  }
+  if (m_record != nullptr) m_record->setGoals(slot, goalsA, goalsB);
+  if constexpr (kGoals) {
+    m_results.stages[5].fill(a + 0.5, goalsA);
+    m_results.stages[5].fill(b + 0.5, goalsB);
+  }
+}
+
+template <bool kStats, bool kPrint, bool kGoals>
+void tournamentRun::playFixturesT(const int* teams, const int n, const float low, const float high, int slot) {
+  for (int i = 0; i < n - 1; ++i) {
+    for (int j = i + 1; j < n; ++j) {
+      playMatchT<kStats, kPrint, kGoals>(teams[i], teams[j], low, high, slot++);
+    }
+  }
+}
+
+// Plays the match and takes out the winner to find the loser, as in a group of two
+template <bool kStats, bool kPrint>
+void tournamentRun::playKnockoutT(const int match, const float low, const float high, int& winner, int& loser) {
+  const fixture& f = m_knockout[match - kFirstKnockoutMatch];
+  playFixturesT<kStats, kPrint, true>(f.teams, f.n, low, high, match - 1); // Knockout games are stored by FIFA match number
+  winner = f.teams[leader(f.teams, f.n)];
+  m_teams[winner].points = -1; // Disable to get runner up
+  loser = f.teams[leader(f.teams, f.n)];
+  if (m_record != nullptr) m_record->setKnockout(match - 1, winner, loser, f.teams[0] != winner);
+}
+
+int tournamentRun::leader(const int* teams, const int n) const {
+  int winningPoints = -1, winningGD = -1, winningGoals = -1, winningRank = 999;
+  int winning = 0;
+  for (int i = 0; i < n; ++i) {
+    const teamState& team = m_teams[teams[i]];
+    const int rank = m_config.team(teams[i]).rank;
+    bool better = false;
+    if ( team.points > winningPoints ) better = true;
+    else if ( team.points == winningPoints) {
+      if (team.goalDiff > winningGD) better = true;
+      else if (team.goals > winningGoals) better = true;
+      else if (rank < winningRank) better = true; // This is not according to FIFA rules
+    }
+    if (better) {
+      winningPoints = team.points;
+      winningGD = team.goalDiff;
+      winningRank = rank;
+      winningGoals = team.goals;
+      winning = i;
+    }
+  }
+  return winning;
+}
+
+void tournamentRun::resetTeams(const bool all) {
+  for (teamState& team : m_teams) {
+    team.points = 0;
+    if (all) {
+      team.goalDiff = 0;
+      team.goals = 0;
+    }
+  }
+}
+
+void tournamentRun::advance(const int match, const int team) {
+  fixture& f = m_knockout[match - kFirstKnockoutMatch];
+  if (f.n < 2) f.teams[f.n++] = team;
+}
+
+void tournamentRun::sortByAbbreviation(std::vector<int>& teams) const { // Keys list them alphabetically
+  std::sort(teams.begin(), teams.end(), [this](const int a, const int b) { return m_config.team(a).abbreviation < m_config.team(b).abbreviation; });
+}
+
+template <bool kPrint>
+tournamentRun::trialKernel tournamentRun::trialKernelFor(const Mode mode) {
+  switch (mode) {
+    case kFULL_TOURNAMENT: return &tournamentRun::playTrialT<kFULL_TOURNAMENT, kPrint>;
+    case kAFTER_GROUP:     return &tournamentRun::playTrialT<kAFTER_GROUP, kPrint>;
+    case kAFTER_16:        return &tournamentRun::playTrialT<kAFTER_16, kPrint>;
+    case kAFTER_QUARTER:   return &tournamentRun::playTrialT<kAFTER_QUARTER, kPrint>;
+    case kAFTER_SEMI:      break;
+  }
+  return &tournamentRun::playTrialT<kAFTER_SEMI, kPrint>;
+}
+
+void tournamentRun::playTrial(const uint64_t trial, const float goalinessLow, const float goalinessHigh, const bool print) {
+  m_random.setSeed(trial + 1); // Seed 0 was a random seed with TRandom3
+  (this->*(print ? trialKernelFor<true>(m_config.mode()) : trialKernelFor<false>(m_config.mode())))(goalinessLow, goalinessHigh);
+  ++m_results.trials;
+}
+
+template <Mode kMode, bool kPrint>
+void tournamentRun::playTrialT(const float low, const float high) {
+  PROFILE_SCOPE("Trial");
+  if (m_record != nullptr) m_record->clear();
+
+  trialOutcome& outcome = m_outcome;
+  outcome.dropOutAt16.clear();
+  outcome.dropOutAtQuarter.clear();
+  outcome.dropOutAtSemi.clear();
+
+  resetTeams(true);
+  for (fixture& f : m_knockout) f.n = 0;
+
+  if constexpr (kMode == kFULL_TOURNAMENT) {
+    PROFILE_SCOPE("Trial: group stage");
+    for (int g = 0; g < m_config.nGroups(); ++g) {
+      const std::vector<int>& teams = m_config.group(g);
+      playFixturesT<kMode == kFULL_TOURNAMENT, kPrint, true>(teams.data(), teams.size(), low, high, g * 6);
+      int teamPlace[kTeamsPerGroup];
+      for (int position = 0; position < kTeamsPerGroup; ++position) {
+        const int place = leader(teams.data(), teams.size());
+        teamPlace[position] = teams[place];
+        m_teams[teamPlace[position]].points = -1; // Take out of action to get the next one
+        m_results.groupPositions[g * kTeamsPerGroup + position].fill(place);
+      }
+      if constexpr (kPrint) std::cout << "Winner of group " << m_config.groupLetter(g) << ":" << m_config.team(teamPlace[0]).name << ", runner up " << m_config.team(teamPlace[1]).name << std::endl;
+      m_results.stages[0].fill( teamPlace[0] + 0.5 );
+      m_results.stages[0].fill( teamPlace[1] + 0.5 );
+      if (m_config.groupAdvancesTo(g, 0)) advance(m_config.groupAdvancesTo(g, 0), teamPlace[0]);
+      if (m_config.groupAdvancesTo(g, 1)) advance(m_config.groupAdvancesTo(g, 1), teamPlace[1]);
+    }
+  }
+
+  if constexpr (kMode > kFULL_TOURNAMENT) {
+    for (int m = kFirstKnockoutMatch; m < kFirstKnockoutMatch + kKnockoutMatches; ++m) {
+      for (const int team : m_config.knockoutSeeds(m)) advance(m, team);
+    }
+  }
+
+  if constexpr (kMode < kAFTER_16) {
+    PROFILE_SCOPE("Trial: round of 16");
+    resetTeams(false);
+    for (int m = 49; m < 57; ++m) {
+      int winning, dropOut;
+      playKnockoutT<kMode == kAFTER_GROUP, kPrint>(m, low, high, winning, dropOut);
+      if constexpr (kPrint) std::cout << "Winner of round " << m << ":" << m_config.team(winning).name << std::endl;
+      m_results.stages[1].fill( winning + 0.5 ); // Many entries here, so we offset the axis ticks
+      outcome.dropOutAt16.push_back( dropOut );
+      switch (m) {
+        case 49: case 50: advance(57, winning); break;
+        case 51: case 52: advance(59, winning); break;
+        case 53: case 54: advance(58, winning); break;
+        case 55: case 56: advance(60, winning); break;
+      }
+    }
+  }
+
+  if constexpr (kMode < kAFTER_QUARTER) {
+    PROFILE_SCOPE("Trial: quarter finals");
+    resetTeams(false);
+    for (int m = 57; m < 61; ++m) {
+      int winning, dropOut;
+      playKnockoutT<kMode == kAFTER_16, kPrint>(m, low, high, winning, dropOut);
+      if constexpr (kPrint) std::cout << "Winner of QF match " << m << ":" << m_config.team(winning).name << std::endl;
+      m_results.stages[2].fill( winning + 0.5 );
+      outcome.dropOutAtQuarter.push_back( dropOut );
+      advance(m < 59 ? 61 : 62, winning);
+    }
+  }
+
+  if constexpr (kMode < kAFTER_SEMI) {
+    PROFILE_SCOPE("Trial: semi finals");
+    resetTeams(false);
+    int finalistA, finalistB, runnerUpA, runnerUpB;
+    playKnockoutT<kMode == kAFTER_QUARTER, kPrint>(61, low, high, finalistA, runnerUpA);
+    outcome.dropOutAtSemi.push_back( runnerUpA );
+    advance(63, runnerUpA); // Runner up
+    playKnockoutT<kMode == kAFTER_QUARTER, kPrint>(62, low, high, finalistB, runnerUpB);
+    outcome.dropOutAtSemi.push_back( runnerUpB );
+    advance(63, runnerUpB); // Runner up
+    m_results.stages[3].fill( finalistA + 0.5 );
+    m_results.stages[3].fill( finalistB + 0.5 );
+    advance(64, finalistA);
+    advance(64, finalistB);
+  }
+
+  resetTeams(false);
+  outcome.finalistA = m_knockout[64 - kFirstKnockoutMatch].teams[0];
+  outcome.finalistB = m_knockout[64 - kFirstKnockoutMatch].teams[1];
+  playKnockoutT<kMode == kAFTER_SEMI, kPrint>(63, low, high, outcome.third, outcome.fourth);
+  playKnockoutT<kMode == kAFTER_SEMI, kPrint>(64, low, high, outcome.winner, outcome.second);
+  m_results.stages[4].fill( outcome.winner + 0.5 );
+  sortByAbbreviation(outcome.dropOutAt16);
+  sortByAbbreviation(outcome.dropOutAtQuarter);
+  sortByAbbreviation(outcome.dropOutAtSemi);
+}
+
+const std::string& tournamentRun::recordOutcome() {
+  PROFILE_SCOPE("Outcome keys");
+  // Built in place, the maps only copy the key for an outcome not seen before
+  std::string& key = m_outcomeKey;
+  key.clear();
+  key.append(m_config.team(m_outcome.winner).abbreviation).append("/").append(m_config.team(m_outcome.second).abbreviation).append("/");
+  int i = 0;
+  for (const int t : m_outcome.dropOutAtSemi) {
+    key.append(m_config.team(t).abbreviation);
+    if (++i < 2) key.append("_");
+  }
+
+  m_results.outcomesToSemi[ key ]++;
+
+  key.append("/");
+  i = 0;
+  for (const int t : m_outcome.dropOutAtQuarter) {
+    key.append(m_config.team(t).abbreviation);
+    if (++i < 4) key.append("_");
+  }
+
+  m_results.outcomesToQuarter[ key ]++;
+
+  key.append("/");
+  i = 0;
+  for (const int t : m_outcome.dropOutAt16) {
+    key.append(m_config.team(t).abbreviation);
+    if (++i < 8) key.append("_");
+  }
+
+  m_results.outcomes[ key ]++;
+  return key;
+}
+
+void tournamentRun::simulate(const uint64_t first, const uint64_t last, const float goalinessLow, const float goalinessHigh) {
+  for (uint64_t trial = first; trial < last; ++trial) {
+    playTrial(trial, goalinessLow, goalinessHigh);
+    recordOutcome();
+  }
+}
+
+void tournamentRun::playGroupStage(const uint64_t trial, const float goalinessLow, const float goalinessHigh) {
+  m_random.setSeed(trial + 1);
+  for (int g = 0; g < m_config.nGroups(); ++g) {
+    const std::vector<int>& teams = m_config.group(g);
+    playFixturesT<false, false, false>(teams.data(), teams.size(), goalinessLow, goalinessHigh, g * 6);
+  }
+  ++m_results.trials;
+}
+
+void tournamentRun::playMatch(const int teamA, const int teamB, const float goalinessLow, const float goalinessHigh, const int slot) {
+  playMatchT<false, false, false>(teamA, teamB, goalinessLow, goalinessHigh, slot);
+}
+
+void tournamentRun::playGroup(const int group, const float goalinessLow, const float goalinessHigh) {
+  const std::vector<int>& teams = m_config.group(group);
+  playFixturesT<false, false, false>(teams.data(), teams.size(), goalinessLow, goalinessHigh, group * 6);
+}
+
+int tournamentRun::groupWinner(const int group) const {
+  const std::vector<int>& teams = m_config.group(group);
+  return teams[leader(teams.data(), teams.size())];
+}
+
+void tune(const tournamentConfig& config, const tuningGrid& grid, tuningResult& result, const tuningProgress& progress) {
+  PROFILE_SCOPE("runTraining");
+  result = tuningResult();
+  for (float low = grid.startLow; low < grid.stopLow; low += grid.step) { // Same points as below
+    for (float high = grid.startHigh; high > grid.stopHigh; high -= grid.step) result.trialsTotal += (high - low < 1e-2 ? 0 : grid.trials);
+  }
+
+  tournamentRun run(config);
+  const bool test = (config.goalsTest().integral() > 0);
+  float bestChi = 999;
+  for (float low = grid.startLow; low < grid.stopLow; low += grid.step) {
+    for (float high = grid.startHigh; high > grid.stopHigh; high -= grid.step) {
+      if (high - low < 1e-2) continue;
+      PROFILE_SCOPE("Training grid point");
+      LOG_DEBUG("[{.4},{.4}]", low, high);
+
+      run.results().reset();
+      for (int trial = 0; trial < grid.trials; ++trial) {
+        run.playGroupStage(trial, low, high);
+        ++result.trialsDone;
+        if (progress) progress(result);
+      }
+
+      const float goodnessA = chi2PerDof(config.goalsTraining(), run.results().goals);
+      const float goodnessB = chi2PerDof(config.goalDiffTraining(), run.results().goalDiff);
+      result.points.push_back({low, high, goodnessA + goodnessB});
+
+      if ( goodnessA + goodnessB < bestChi) {
+        bestChi = goodnessA + goodnessB;
+        if (test) {
+          result.chi2G_Test  = chi2PerDof(config.goalsTest(), run.results().goals);
+          result.chi2GD_Test = chi2PerDof(config.goalDiffTest(), run.results().goalDiff);
+        }
+        result.chi2G_Training = goodnessA;
+        result.chi2GD_Training = goodnessB;
+        result.low = low;
+        result.high = high;
+        LOG_INFO("--- Chi2 of:{.4} for Low:{.4} High:{.4}", goodnessA + goodnessB, low, high);
+      }
+    }
+  }
+  LOG_INFO("chi2 when using the Training tuning dataset: G={.4} GD={.4}", result.chi2G_Training, result.chi2GD_Training);
+  LOG_INFO("chi2 against the Test dataset: G={.4} GD={.4}", result.chi2G_Test, result.chi2GD_Test);
+}
+
+bool knownTuning(const int year, tuningResult& result) {
+  result = tuningResult();
+  switch (year) {
+    case 2022:
+      result.low = 1.53;
+      result.high = 1.54;
+      result.chi2G_Training = 1.594;
+      result.chi2GD_Training = 0.8898;
+      return true;
+    case 2018:
+      result.low = 1.52;
+      result.high = 1.79;
+      result.chi2G_Training = 1.03463;
+      result.chi2GD_Training = 0.616308;
+      return true;
+  }
+  return false;
+}
+
+double chi2PerDof(const binCounts& data, const binCounts& mc) {
+  // Bins with weighted entries count as their effective number of entries, as the NORM option
+  const int nBins = data.cells() - 2;
+  std::vector<double> n1(nBins), n2(nBins);
+  double sum1 = 0, sum2 = 0;
+  for (int i = 0; i < nBins; ++i) {
+    n1[i] = data.effectiveCount(i + 1);
+    n2[i] = mc.effectiveCount(i + 1);
+    sum1 += n1[i];
+    sum2 += n2[i];
+  }
+  if (sum1 == 0 || sum2 == 0) return 0;
+  double chi2 = 0;
+  int ndf = nBins - 1;
+  for (int i = 0; i < nBins; ++i) {
+    if (n1[i] == 0 && n2[i] == 0) {
+      --ndf; // No data means one degree of freedom less
+      continue;
+    }
+    const double delta = sum2 * n1[i] - sum1 * n2[i];
+    chi2 += delta * delta / (n1[i] + n2[i]);
+  }
+  chi2 /= sum1 * sum2;
+  return (ndf > 0 ? chi2 / ndf : 0);
+}
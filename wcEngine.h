@@ -0,0 +1,252 @@
+#ifndef WCMC_WCENGINE_H
+#define WCMC_WCENGINE_H
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "binCounts.h"
+#include "historicMatches.h"
+#include "trialStore.h"
+
+// The simulation on its own, without ROOT, for wcMC.exe or anything else that embeds it.
+//   tournamentConfig config;                        Teams, groups and training data of one year and Mode
+//   config.load(2022, kFULL_TOURNAMENT);
+//   tuningResult tuning;
+//   tune(config, tuningGrid{...}, tuning);          Or knownTuning(2022, tuning)
+//   tournamentRun run(config);                      Random numbers, team tables and counts of one run
+//   run.simulate(0, 1000000, tuning.low, tuning.high);
+//   run.results().stageProbability(team, 4);
+// A config is read-only once loaded and may be shared by any number of runs on any number of threads. A run is cheap
+// and used by one thread at a time. Trial t is always seeded with t + 1, so runs over disjoint ranges of trials add up
+// (simulationResults::add) to exactly the results of one run over all of them.
+
+enum Mode {kFULL_TOURNAMENT, kAFTER_GROUP, kAFTER_16, kAFTER_QUARTER, kAFTER_SEMI};
+
+const std::string kStagePassed[5] = {"Group", "R16", "QF", "SF", "F"}; // Indexed as simulationResults::stages
+
+const int kFirstKnockoutMatch = 49; // FIFA match numbers 49-64, 63 is for third place
+const int kKnockoutMatches = 16;
+const int kTeamsPerGroup = 4;
+
+// Mersenne twister seeded and drawn as TRandom3, so a seed plays the same tournament as it did with ROOT
+class wcRandom {
+public:
+  explicit wcRandom(const uint64_t seed = 4357) { setSeed(seed); }
+
+  void setSeed(const uint64_t seed) { // Truncated to 32 bits as TRandom3. Unlike TRandom3, 0 is not a random seed
+    m_mt[0] = (uint32_t) seed;
+    for (int i = 1; i < kN; ++i) m_mt[i] = 1812433253u * (m_mt[i - 1] ^ (m_mt[i - 1] >> 30)) + i;
+    m_count = kN;
+  }
+
+  double rndm() { // In (0, 1)
+    while (true) {
+      if (m_count >= kN) generate();
+      uint32_t y = m_mt[m_count++];
+      y ^= (y >> 11);
+      y ^= (y << 7) & 0x9d2c5680u;
+      y ^= (y << 15) & 0xefc60000u;
+      y ^= (y >> 18);
+      if (y) return y * 2.3283064365386963e-10; // 2^-32
+    }
+  }
+
+  int poisson(const double mean) { // Multiplies uniforms below a mean of 25, as TRandom::Poisson
+    if (mean <= 0) return 0;
+    if (mean >= 25) return poissonLarge(mean);
+    const double expMean = std::exp(-mean);
+    double pir = 1;
+    int n = -1;
+    do {
+      ++n;
+      pir *= rndm();
+    } while (pir > expMean);
+    return n;
+  }
+
+private:
+  static const int kN = 624;
+  void generate();
+  int poissonLarge(const double mean);
+
+  uint32_t m_mt[kN];
+  int m_count;
+};
+
+struct engineTeam {
+  std::string name;
+  std::string abbreviation;
+  int rank; // Line of the ranking file, counting teams that were not loaded
+};
+
+// Everything a trial reads: teams (indexed in ranking order), groups, the later round teams of the Mode and the training data
+class tournamentConfig {
+public:
+  tournamentConfig() : m_year(0), m_mode(kFULL_TOURNAMENT), m_totalTeams(0) {}
+
+  // Reads wc_<year>_*.txt, and the historic database if one is given. False, with the reason printed, if the data is unusable
+  bool load(const int year, const Mode mode, const std::string& historic = "", const historicFilter& selection = historicFilter());
+
+  int year() const { return m_year; }
+  Mode mode() const { return m_mode; }
+  int totalTeams() const { return m_totalTeams; } // In the ranking file, sets the goaliness scale
+  int nTeams() const { return m_teams.size(); }
+  const engineTeam& team(const int index) const { return m_teams[index]; }
+  int teamIndex(const std::string& name) const; // -1 if not loaded
+  int nGroups() const { return m_groupLetters.size(); }
+  const std::string& groupLetter(const int group) const { return m_groupLetters[group]; }
+  const std::vector<int>& group(const int group) const { return m_groups[group]; } // Team indices, in the order of the groups file
+  int groupIndex(const std::string& letter) const; // -1 if there is no such group
+  int groupAdvancesTo(const int group, const int place) const { return m_advance[group][place]; } // Match of the winner (0) or runner up (1), 0 if none
+  const std::vector<int>& laterRoundTeams() const { return m_laterRoundTeams; } // Team indices, in the order of the pass file of the Mode
+  const std::vector<int>& knockoutSeeds(const int match) const { return m_seeds[match - kFirstKnockoutMatch]; } // Teams already in the match, from the pass file
+
+  // Goals and absolute goal difference per match, 0-8 with the overflow above
+  const binCounts& goalsTraining() const { return m_goalsTraining; }
+  const binCounts& goalDiffTraining() const { return m_goalDiffTraining; }
+  const binCounts& goalsTest() const { return m_goalsTest; } // This year's games, empty if not played yet
+  const binCounts& goalDiffTest() const { return m_goalDiffTest; }
+  const std::string& trainingLabel() const { return m_trainingLabel; } // e.g. "14+18"
+
+  std::string dataFile(const std::string& what, const int year = 0) const; // wc_<year>_<what>.txt
+  static std::vector<std::string> readLine(const std::string& line); // Whitespace separated fields, with a '-' in a field read as a space
+
+private:
+  bool loadTeams();
+  void seedKnockout();
+  bool loadGroups();
+  void loadHistoricData(const std::string& historic, const historicFilter& selection);
+  bool loadHistoricMatches(const std::string& historic, const historicFilter& selection);
+  void addHistoric(const int goalsA, const int goalsB, const int year);
+
+  int m_year;
+  Mode m_mode;
+  int m_totalTeams;
+  std::vector<engineTeam> m_teams;
+  std::vector<std::string> m_groupLetters;
+  std::vector<std::vector<int>> m_groups;
+  std::vector<std::vector<int>> m_advance;
+  std::vector<int> m_laterRoundTeams;
+  std::vector<int> m_seeds[kKnockoutMatches];
+  binCounts m_goalsTraining, m_goalDiffTraining, m_goalsTest, m_goalDiffTest;
+  std::string m_trainingLabel;
+};
+
+// The counts of the trials of one or more runs. Stage and position counts are by team index and by place in the group
+struct simulationResults {
+  void init(const tournamentConfig& config);
+  void reset();
+  void add(const simulationResults& other); // Another run of the same config, e.g. on another thread or shard
+  binCounts& score(const int teamA, const int teamB); // Score matrix of the fixture, booked on first use
+  bool played(const int teamA, const int teamB) const { return scores[teamA * nTeams + teamB].cells() > 0; }
+  double stageProbability(const int team, const int stage) const; // Of passing kStagePassed[stage]
+
+  int nTeams = 0;
+  uint64_t trials = 0;
+  binCounts goals, goalDiff; // Per match
+  binCounts stages[6]; // Teams passing stages 0-4, 5 is the goals each team scored
+  std::vector<binCounts> groupPositions; // [group * kTeamsPerGroup + position]
+  std::vector<binCounts> scores; // [teamA * nTeams + teamB], in the order the teams were drawn
+  std::map<std::string, uint64_t> outcomes; // Keyed by "W/2nd/SFs/QFs/R16s" abbreviations
+  std::map<std::string, uint64_t> outcomesToQuarter;
+  std::map<std::string, uint64_t> outcomesToSemi;
+};
+
+// Team indices, sized up front and reused between trials so that a trial does not allocate
+struct trialOutcome {
+  trialOutcome() : winner(-1), second(-1), third(-1), fourth(-1), finalistA(-1), finalistB(-1) { dropOutAt16.reserve(8); dropOutAtQuarter.reserve(4); dropOutAtSemi.reserve(2); }
+  int winner, second, third, fourth, finalistA, finalistB;
+  std::vector<int> dropOutAt16, dropOutAtQuarter, dropOutAtSemi; // Sorted by abbreviation
+};
+
+// Per-run state. The config must outlive the run
+class tournamentRun {
+public:
+  explicit tournamentRun(const tournamentConfig& config);
+
+  // Trial t of the config's Mode, seeded with t + 1. Print writes every game and round winner to std::cout
+  void playTrial(const uint64_t trial, const float goalinessLow, const float goalinessHigh, const bool print = false);
+  const std::string& recordOutcome(); // Counts the last trial's outcome, returns its key. Valid until the next call
+  void simulate(const uint64_t first, const uint64_t last, const float goalinessLow, const float goalinessHigh); // Plays and records trials [first, last)
+  void playGroupStage(const uint64_t trial, const float goalinessLow, const float goalinessHigh); // Group games only, only their goals counted, for tuning
+
+  void setTrialRecord(trialRecord* record) { m_record = record; } // Filled in by each trial for a trial store, nullptr for none
+  const trialOutcome& outcome() const { return m_outcome; }
+  const simulationResults& results() const { return m_results; }
+  simulationResults& results() { return m_results; }
+  const tournamentConfig& config() const { return m_config; }
+  wcRandom& random() { return m_random; }
+
+  // The hot paths on their own, for benchmarks. No score matrices, team goals or printout, and slot is the trial store slot
+  void playMatch(const int teamA, const int teamB, const float goalinessLow, const float goalinessHigh, const int slot);
+  void playGroup(const int group, const float goalinessLow, const float goalinessHigh);
+  int groupWinner(const int group) const; // Team index
+
+private:
+  struct teamState {
+    int points;
+    int goalDiff;
+    int goals;
+  };
+  struct fixture { // A knockout match, filled in as its teams qualify
+    int teams[2];
+    int n;
+  };
+
+  template <bool kStats, bool kPrint, bool kGoals>
+  void playMatchT(const int a, const int b, const float low, const float high, const int slot);
+  template <bool kStats, bool kPrint, bool kGoals>
+  void playFixturesT(const int* teams, const int n, const float low, const float high, int slot); // Every pair, as a group
+  template <bool kStats, bool kPrint>
+  void playKnockoutT(const int match, const float low, const float high, int& winner, int& loser);
+  // One kernel per Mode, score matrices are recorded for the first stage simulated
+  template <Mode kMode, bool kPrint>
+  void playTrialT(const float low, const float high);
+  typedef void (tournamentRun::*trialKernel)(const float, const float);
+  template <bool kPrint>
+  static trialKernel trialKernelFor(const Mode mode);
+  int leader(const int* teams, const int n) const; // Position in teams of the best placed team
+  void resetTeams(const bool all);
+  void advance(const int match, const int team);
+  void sortByAbbreviation(std::vector<int>& teams) const;
+
+  const tournamentConfig& m_config;
+  wcRandom m_random;
+  std::vector<teamState> m_teams;
+  fixture m_knockout[kKnockoutMatches];
+  trialOutcome m_outcome;
+  std::string m_outcomeKey; // Reused by recordOutcome
+  simulationResults m_results;
+  trialRecord* m_record;
+};
+
+// Goaliness search. Low goes up from startLow and high down from startHigh in steps, points where high is not above low are skipped
+struct tuningGrid {
+  float startLow, stopLow, startHigh, stopHigh, step;
+  int trials; // Group stages per point
+};
+
+struct tuningPoint {
+  float low, high, chi2; // Goals plus goal difference chi2/NDF against the training data
+};
+
+struct tuningResult {
+  float low = 0, high = 0; // Best point
+  float chi2G_Training = -1, chi2GD_Training = -1, chi2G_Test = -1, chi2GD_Test = -1; // chi2/NDF at the best point, -1 if not available
+  uint64_t trialsDone = 0, trialsTotal = 0;
+  std::vector<tuningPoint> points; // Every point played, in order
+  float chi2() const { return (chi2G_Training < 0 ? -1 : chi2G_Training + chi2GD_Training); }
+};
+
+typedef std::function<void(const tuningResult&)> tuningProgress; // Called after every trial
+
+void tune(const tournamentConfig& config, const tuningGrid& grid, tuningResult& result, const tuningProgress& progress = tuningProgress());
+bool knownTuning(const int year, tuningResult& result); // Tunings of earlier runs, false if there is none for the year
+
+// chi2/NDF of two unweighted count distributions of different sizes, in-range bins only, as TH1::Chi2Test "NORM UU CHI2/NDF"
+double chi2PerDof(const binCounts& data, const binCounts& mc);
+
+#endif // WCMC_WCENGINE_H
@@ -5,688 +5,462 @@
 #include <sstream>
 #include <vector>
 #include <iomanip>
-#include <TRandom3.h>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <TROOT.h>
 #include <TH2.h>
-#include "nicePlot.cxx"
+#include <TFile.h>
+#include "profile.h"
+#include "logger.h"
+#include "progressSnapshot.h"
+#include "nicePlot.h"
+#include "AtlasStyle.h"
+#include "trialStore.h"
+#include "trialQuery.h"
+#include "backtest.h"
+#include "partialResults.h"
+#include "wcEngine.h"
+#include "wcResults.h"
+
+const uint64_t kProgressTrials = 1024; // Trials between a thread's progress updates
+
+struct RunOptions {
+  int year = 2022; // Selects the wc_<year>_*.txt data files and tuning
+  uint64_t trials = 1000000;
+  bool plots = true;
+  int threads = 1; // Simulating runFinal's trials, 0 for one per core
+  std::string trialStore; // If set, every trial of runFinal is written to this columnar file
+  std::vector<std::string> queries; // Run against the trial store in place of the outcome printing
+  std::string baseline; // Backtest summary to compare against
+  int shard = 0; // Run trials [shard, shard + 1) * trials / shards and write them to a partial results file
+  int shards = 1;
+  std::string partial;
+  std::vector<std::string> merge; // Partial results files to combine instead of simulating
+  bool headless = false; // No style setup or plots
+  std::string results; // Machine-readable results file
+  unsigned plotFormats = kDefaultFormats; // bookFormat_t mask, per-plot .root files only on request
+  bool rootOutput = true; // Consolidated ROOT file of the raw histograms
+  std::string rootFile; // Default WCMC_<year>_Mode<m>.root
+  int plotWorkers = 1; // Processes exporting the per-page plot files, 0 for one per core
+  bool replot = false; // Render every page even if its inputs are unchanged
+  std::string report; // Self-contained HTML report
+  std::string snapshot; // JSON progress file rewritten during training and simulation
+  double snapshotInterval = 5; // Seconds
+  std::string historic; // CSV of international results to train on instead of the earlier World Cups
+  historicFilter historicSelection; // Dates default to before this tournament
+};
 
-enum Mode {kFULL_TOURNAMENT, kAFTER_GROUP, kAFTER_16, kAFTER_QUARTER, kAFTER_SEMI};
+void queryTrialStore(const std::string& fname, std::vector<std::string> queries) {
+  trialReader store;
+  if (!store.open(fname)) return;
+  std::cout << "Querying " << store.trials() << " trials from " << fname << std::endl;
+  if (queries.empty()) {
+    queries.push_back("dist M64");
+    if (store.header().mode < 4) queries.push_back("joint M61 M62"); // Final pairings, unless known
+  }
+  trialQuery query(store);
+  for (const std::string& q : queries) query.run(q);
+}
 
-class WCMC {  
+// The ROOT front end of the engine (wcEngine.h): tunes and simulates with it on threads, hands the results to wcResults.h and plots them
+class WCMC {
   public:
-    WCMC(const Mode mode);
-    void doMatch(const std::string& a, const std::string& b, const float low, const float high);
-    void doGroup(const std::string& group, const float low, const float high);
-    void addHistoric(int goalsA, int goalsB, int year);
-    void loadHistoricData();
-    void addTeams();
-    void addTeam(const std::string& t, const std::string& abreviation, const int rank);
-    std::vector<std::string> readLine(const std::string& line);
-    void addGroups();
-    void addGroup(const std::string& group, const std::string& A, const std::string& B, const std::string& C, const std::string& D);
-    void resetTeamStatistics(const bool all);
-    void resetLaterGroups();
-    void runTraining(float& resultLow, float& resultHigh, const float startLow, const float stopLow, const float startHigh, const float stopHigh, const float step);
-    const std::string getWinningTeam(const std::string group);
-    void runFinal(const float goalinessLow, const float goalinessHigh);
-    void recordStats(const std::string a, const std::string b, const int goalsA, const int goalsB);
+    WCMC(const Mode mode, const RunOptions& options = RunOptions());
+    bool load(); // Reads the data files, false if they are unusable
+    void runTraining(tuningResult& result, const float startLow, const float stopLow, const float startHigh, const float stopHigh, const float step);
+    bool runFinal(); // At the goaliness of m_tuning. False if the trial store cannot be written
+    void simulateTrials(tournamentRun& run, const int thread, const uint64_t first, const uint64_t last, const float goalinessLow, const float goalinessHigh);
+    void shareProgress(const int thread, const tournamentRun& run);
+    void reportOutcomes();
+    TH2D* getMatchResult(const std::string& key);
+    void fillHistograms();
+    std::string partialFileName();
+    bool writePartial(const uint64_t first, const uint64_t last);
+    bool mergePartials();
+    void publishProgress();
+    bool openTrialStore();
     void execute();
+    void plotResults();
+    bool writeRootFile(const std::string& fname);
 
-    struct Team {
-      Team() { m_points = 0; m_goalDiff = 0; m_goals = 0; m_rank = 0; m_index = 0; }
-      int m_rank;
-      int m_index;
-      int m_points;
-      int m_goalDiff;
-      int m_goals;
-      std::string m_abreviation;
+    // A simulating thread's counts so far, for the progress snapshot
+    struct threadProgress {
+      uint64_t trials = 0;
+      std::vector<uint64_t> stageCounts; // [team * 5 + stage]
     };
 
-    std::map<std::string, Team > m_teams;
-    std::map<std::string, std::vector<std::string>> m_groups;   
-    TRandom3 R;
-    TH1F* m_h_GoalsMC;
+    tournamentConfig m_config;
+    simulationResults m_results; // Of every run of runFinal, or of the merged partial results
+    tuningResult m_tuning; // Goaliness used for the results and the chi2 values, without the grid points
+    TH1D* m_h_GoalsMC;
     TH1F* m_h_GoalsData_Test;
     TH1F* m_h_GoalsData_Training;
-    TH1F* m_h_GoalDiffMC;
+    TH1D* m_h_GoalDiffMC;
     TH1F* m_h_GoalDiffData_Test;
     TH1F* m_h_GoalDiffData_Training;
     TH2F* m_h_trainCorse;
     TH2F* m_h_trainFine;
-    std::map<std::string, TH2F*> m_h_matchResult;
-    std::map<std::string, TH1F*> m_h_roundWinner;
-    std::map<std::string, std::string> m_teamToAbrieviation;
-    int m_trialsMax;
-    int m_totalTeams;
-    bool m_matchPrint, m_matchStats, m_goalsScored;
-    std::vector<std::string> group_letters;
-    std::vector<std::string> m_teamsByRank;
-    std::vector<std::string> m_laterRoundTeams;
-    float m_bestChiG_Test, m_bestChiGD_Test, m_bestChiG_Training, m_bestChiGD_Training;
+    std::map<std::string, TH2D*> m_h_matchResult;
+    std::map<std::string, TH1D*> m_h_roundWinner;
+    uint64_t m_trialsMax;
     Mode m_mode; // Tournament progression
+    int m_year;
+    forecastScorer m_scorer;
+    RunOptions m_options;
+    trialWriter* m_trialWriter;
+    trialRecord m_trialRecord;
+    progressSnapshot m_snapshot;
+    progressState m_progress; // Phase, counts and tuning so far, filled in by runTraining and runFinal
+    std::vector<threadProgress> m_threadProgress;
+    std::mutex m_threadProgressMutex;
 };
 
-void WCMC::doMatch(const std::string& a, const std::string& b, const float low, const float high) {
-  const float reduction = m_totalTeams / high;
-
-  // std::cout << "     Match " << a << " vs " << b << std::endl;
-
-  float scoreA = low + ((m_totalTeams - m_teams[a].m_rank) / reduction);
-  float scoreB = low + ((m_totalTeams - m_teams[b].m_rank) / reduction);
-  while ( scoreA > low && scoreB > low) {
-    scoreA -= R.Rndm() * low;
-    scoreB -= R.Rndm() * low;
-  }
-
-  const int goalsA = R.Poisson(scoreA);
-  const int goalsB = R.Poisson(scoreB);
-
-  m_h_GoalsMC->Fill(goalsA + goalsB);
-  m_h_GoalDiffMC->Fill( abs(goalsA - goalsB) );
-
-  if (goalsA > goalsB) {
-    m_teams[a].m_points += 3;
-  } else if (goalsB > goalsA) {
-    m_teams[b].m_points += 3;
-  } else if (goalsA == goalsB) {
-    m_teams[a].m_points += 1;
-    m_teams[b].m_points += 1;
-  }
-
-  m_teams[a].m_goals += goalsA;
-  m_teams[b].m_goals += goalsB;
-  m_teams[a].m_goalDiff += goalsA - goalsB;
-  m_teams[b].m_goalDiff += goalsB - goalsA;
-  
-  if (m_matchPrint) std::cout << a << ":" << goalsA << " - " << b << ":" << goalsB << " | "; 
-  if (m_matchStats) recordStats(a, b, goalsA, goalsB);
-  if (m_goalsScored) {
-    m_h_roundWinner["5"]->Fill(m_teams[a].m_index + 0.5, goalsA);
-    m_h_roundWinner["5"]->Fill(m_teams[b].m_index + 0.5, goalsB);
-  }
-}
-
-void WCMC::recordStats(const std::string a, const std::string b, const int goalsA, const int goalsB) {
-  const std::string key = a + "_" + b;
-  std::map<std::string, TH2F*>::iterator it = m_h_matchResult.find(key);
-  if (it == m_h_matchResult.end()) {
-    m_h_matchResult[key] = new TH2F(key.c_str(), key.c_str(), 8, -.5, 7.5, 8, -.5, 7.5);
+// Hands the progress so far to the snapshot thread. Stage counts are only meaningful while simulating
+void WCMC::publishProgress() {
+  PROFILE_SCOPE("Progress snapshot");
+  m_progress.year = m_year;
+  m_progress.mode = (int)m_mode;
+  m_progress.stages.clear();
+  m_progress.teams.clear();
+  if (m_progress.phase != "simulation") {
+    m_progress.threadTrials.assign(1, m_progress.trialsDone);
+    m_snapshot.publish(m_progress);
+    return;
   }
-  m_h_matchResult[key]->Fill(goalsA, goalsB);
-}
-
-void WCMC::doGroup(const std::string& group, const float low, const float high) {
-  const std::vector<std::string>& teams = m_groups.at(group);
-  // std::cout << " Do group " << group << ", size " << teams.size() << std::endl;
-  for (unsigned i = 0; i < teams.size() - 1; ++i) {
-    for (unsigned j = i + 1; j < teams.size(); ++j) {
-      doMatch(teams.at(i), teams.at(j), low, high);
+  for (int i = (int)m_mode; i < 5; ++i) m_progress.stages.push_back(kStagePassed[i]);
+  for (int t = 0; t < m_config.nTeams(); ++t) m_progress.teams.push_back(m_config.team(t).name);
+  m_progress.stageCounts.resize(m_config.nTeams());
+  for (std::vector<double>& counts : m_progress.stageCounts) counts.assign(5 - (int)m_mode, 0);
+  m_progress.threadTrials.clear();
+  m_progress.trialsDone = 0;
+  std::lock_guard<std::mutex> lock(m_threadProgressMutex);
+  for (const threadProgress& thread : m_threadProgress) {
+    m_progress.threadTrials.push_back(thread.trials);
+    m_progress.trialsDone += thread.trials;
+    if (thread.stageCounts.empty()) continue; // Not shared yet
+    for (int t = 0; t < m_config.nTeams(); ++t) {
+      for (int i = (int)m_mode; i < 5; ++i) m_progress.stageCounts[t][i - (int)m_mode] += thread.stageCounts[t * 5 + i];
     }
   }
+  m_snapshot.publish(m_progress);
 }
 
-void WCMC::addTeam(const std::string& t, const std::string& abreviation, const int rank) {
-  const int pos = m_teams.size();
-  m_teams[t] = Team();
-  m_teams[t].m_rank = rank;
-  m_teams[t].m_index = pos;
-  m_teams[t].m_abreviation = abreviation;
-  std::cout << "Team " << t << " (" << abreviation << ") Rank:" << rank << " Index:" << pos << std::endl; 
-  m_teamsByRank.push_back(t);
-  m_teamToAbrieviation[t] = abreviation;
-}
-
-void WCMC::addHistoric(int goalsA, int goalsB, int year) {
-  switch (year) {
-    case 2014: m_h_GoalDiffData_Training->Fill(abs( goalsA - goalsB )); m_h_GoalsData_Training->Fill(goalsA + goalsB); break;
-    case 2018: m_h_GoalDiffData_Training->Fill(abs( goalsA - goalsB )); m_h_GoalsData_Training->Fill(goalsA + goalsB); break;
-    case 2022: m_h_GoalDiffData_Test->Fill(abs( goalsA - goalsB )); m_h_GoalsData_Test->Fill(goalsA + goalsB); break;
+void WCMC::shareProgress(const int thread, const tournamentRun& run) {
+  std::lock_guard<std::mutex> lock(m_threadProgressMutex);
+  threadProgress& progress = m_threadProgress.at(thread);
+  progress.trials = run.results().trials;
+  progress.stageCounts.resize(m_config.nTeams() * 5);
+  for (int t = 0; t < m_config.nTeams(); ++t) {
+    for (int i = 0; i < 5; ++i) progress.stageCounts[t * 5 + i] = run.results().stages[i].count(t + 1);
   }
 }
 
-void WCMC::loadHistoricData() {  // 2014 WC
-  std::string line;
-  std::ifstream historic2014("wc_2014_results.txt");
-  while ( getline(historic2014, line) ) {
-    std::vector<std::string> results = readLine(line);
-    addHistoric(std::stoi(results[0]), std::stoi(results[1]), 2014);
-  }
-  std::ifstream historic2018("wc_2018_results.txt");
-  while ( getline(historic2018, line) ) {
-    std::vector<std::string> results = readLine(line);
-    addHistoric(std::stoi(results[0]), std::stoi(results[1]), 2018);
-  }
-  m_h_GoalDiffData_Test->Scale( 1. / m_h_GoalDiffData_Test->Integral() );
-  m_h_GoalsData_Test->Scale(1. / m_h_GoalsData_Test->Integral() );
-  m_h_GoalDiffData_Training->Scale( 1. / m_h_GoalDiffData_Training->Integral() );
-  m_h_GoalsData_Training->Scale(1. / m_h_GoalsData_Training->Integral() );
-}
-
-std::vector<std::string> WCMC::readLine(const std::string& line) {
-  std::istringstream buf(line);
-  std::istream_iterator<std::string> beg(buf), end;
-  std::vector<std::string> results(beg, end);
-  for (size_t i = 0; i < results.size(); ++i) {
-    size_t location = results[i].find("-");
-    if (location != std::string::npos) results[i].replace(location, 1, " ");
+TH2D* WCMC::getMatchResult(const std::string& key) {
+  std::map<std::string, TH2D*>::iterator it = m_h_matchResult.find(key);
+  if (it == m_h_matchResult.end()) {
+    it = m_h_matchResult.insert(std::make_pair(key, new TH2D(key.c_str(), key.c_str(), 8, -.5, 7.5, 8, -.5, 7.5))).first;
   }
-  return results;
+  return it->second;
 }
 
-void WCMC::addTeams() {
-
-  std::string line;
-  if (m_mode > kFULL_TOURNAMENT) {
-    std::ifstream pass;
-    if      (m_mode == kAFTER_GROUP)   pass.open("wc_2022_pass_groups.txt");
-    else if (m_mode == kAFTER_16)      pass.open("wc_2022_pass_16.txt");
-    else if (m_mode == kAFTER_QUARTER) pass.open("wc_2022_pass_quarter.txt");
-    else if (m_mode == kAFTER_SEMI)    pass.open("wc_2022_pass_semi.txt");
-
-    while ( getline(pass, line) ) {
-      std::vector<std::string> results = readLine(line);
-      m_laterRoundTeams.push_back( results[0] );
-      std::cout << "Passed stage " << (int)m_mode << ": '" << results[0] << "'" << std::endl;
+// Output histograms from the results of the trials since they were last reset
+void WCMC::fillHistograms() {
+  m_results.goals.copyTo(m_h_GoalsMC);
+  m_results.goalDiff.copyTo(m_h_GoalDiffMC);
+  for (int i = 0; i < 6; ++i) m_results.stages[i].copyTo(m_h_roundWinner.at(std::to_string(i)));
+  for (int g = 0; g < m_config.nGroups(); ++g) {
+    for (int position = 0; position < kTeamsPerGroup; ++position) {
+      m_results.groupPositions[g * kTeamsPerGroup + position].copyTo(m_h_roundWinner.at(m_config.groupLetter(g) + std::to_string(position)));
     }
   }
-
-  std::ifstream teams("wc_2022_team_ranks.txt");
-  m_totalTeams = 0;
-  while ( getline(teams, line) ) {
-    std::vector<std::string> results = readLine(line);
-    if (m_mode == kFULL_TOURNAMENT || std::count(m_laterRoundTeams.begin(), m_laterRoundTeams.end(), results[0]) != 0)  {
-      addTeam(results[0], results[1], /*rank ==*/ m_totalTeams);
-    } else std::cout << "  Dropping team: '" << results[0] << "'" << std::endl;
-    ++m_totalTeams;
-  }
-
-  /*
-  std::ifstream teams_updated("wc_2018_team_ranks_updated.txt");
-  int rank = 0;
-  while ( getline(teams_updated, line) ) {
-    std::vector<std::string> results = readLine(line);
-    if (m_mode == kFULL_TOURNAMENT || std::count(m_laterRoundTeams.begin(), m_laterRoundTeams.end(), results[0]) != 0)  {
-      m_teams[results[0]].m_rank = rank;
+  for (int a = 0; a < m_config.nTeams(); ++a) {
+    for (int b = 0; b < m_config.nTeams(); ++b) {
+      if (m_results.played(a, b)) m_results.scores[a * m_results.nTeams + b].copyTo(getMatchResult(m_config.team(a).name + "_" + m_config.team(b).name));
     }
-    ++rank;
   }
-  */
-
-  for (int i = 0; i < 6; ++i) m_h_roundWinner[std::to_string(i)] = new TH1F("", "", m_teams.size(), 0, m_teams.size()); // 5 is a special entry
-}
-
-void WCMC::addGroup(const std::string& group, const std::string& A, const std::string& B, const std::string& C, const std::string& D) {
-  m_groups[group] = {A, B, C, D};
-  group_letters.push_back(group);
-  for (unsigned i = 0; i < m_groups[group].size(); ++i) m_h_roundWinner[group + std::to_string(i)] = new TH1F("","", 4, -.5, 3.5);
 }
 
-void WCMC::resetTeamStatistics(const bool all) {
-  for (auto& entry : m_teams) {
-    entry.second.m_points = 0;
-    if (all) {
-      entry.second.m_goalDiff = 0;
-      entry.second.m_goals = 0;
+bool WCMC::openTrialStore() {
+  trialStoreHeader header;
+  memset(&header, 0, sizeof(header));
+  header.mode = (uint32_t)m_mode;
+  header.nTeams = m_config.nTeams();
+  for (int t = 0; t < m_config.nTeams() && t < (int)kStoreMaxTeams; ++t) {
+    strncpy(header.teamName[t], m_config.team(t).name.c_str(), sizeof(header.teamName[t]) - 1);
+    strncpy(header.teamAbbreviation[t], m_config.team(t).abbreviation.c_str(), sizeof(header.teamAbbreviation[t]) - 1);
+  }
+  memset(header.fixtureA, kSlotNotPlayed, kGroupSlots);
+  memset(header.fixtureB, kSlotNotPlayed, kGroupSlots);
+  for (int g = 0; g < m_config.nGroups(); ++g) {
+    const std::vector<int>& teams = m_config.group(g);
+    int slot = g * 6;
+    for (unsigned i = 0; i < teams.size() - 1; ++i) {
+      for (unsigned j = i + 1; j < teams.size(); ++j, ++slot) {
+        header.fixtureA[slot] = teams.at(i);
+        header.fixtureB[slot] = teams.at(j);
+      }
     }
   }
-}
-
-void WCMC::resetLaterGroups() {
-  for (int i = 49; i < 65; ++i) {
-    m_groups[std::to_string(i)].clear();
+  m_trialWriter = new trialWriter();
+  if (!m_trialWriter->open(m_options.trialStore, header)) {
+    delete m_trialWriter;
+    m_trialWriter = nullptr;
+    return false;
   }
+  return true;
 }
 
-void WCMC::addGroups() {
-  std::ifstream groups("wc_2022_groups.txt");
-  std::string line;
-  while ( getline(groups, line) ) {
-    std::vector<std::string> r = readLine(line);
-    addGroup(r[0], r[1], r[2], r[3], r[4]);
-  }
-}
+WCMC::WCMC(const Mode mode, const RunOptions& options) {
+  m_trialsMax = options.trials;
+  m_options = options;
+  m_year = options.year;
+  m_trialWriter = nullptr;
+  m_h_trainCorse = m_h_trainFine = nullptr;
 
-WCMC::WCMC(const Mode mode) {
-  m_trialsMax = 1000000;
-  m_bestChiG_Test = m_bestChiGD_Test = m_bestChiG_Training = m_bestChiGD_Training = -1;
+  m_mode = mode;
 
-  m_mode = mode; 
-    
-  m_h_GoalsMC = new TH1F("MC",";Goals;Fraction",9,-0.5,8.5);
+  m_h_GoalsMC = new TH1D("MC",";Goals;Fraction",9,-0.5,8.5);
   m_h_GoalsData_Test = new TH1F("Data",";Goals;",9,-0.5,8.5);
   m_h_GoalsData_Training = new TH1F("Data",";Goals;",9,-0.5,8.5);
-  m_h_GoalDiffMC = new TH1F("MC ",";Goals Difference;Fraction",9,-0.5,8.5);
+  m_h_GoalDiffMC = new TH1D("MC ",";Goals Difference;Fraction",9,-0.5,8.5);
   m_h_GoalDiffData_Test = new TH1F("MC ",";Goals Difference;Fraction",9,-0.5,8.5);
   m_h_GoalDiffData_Training = new TH1F("MC ",";Goals Difference;Fraction",9,-0.5,8.5);
+}
 
-  std::cout << "Loading Historic" << std::endl;
-  loadHistoricData();
-  std::cout << "Loading Teams" << std::endl;
-  addTeams();
-  if (m_mode == kFULL_TOURNAMENT) {
-    std::cout << "Loading Groups" << std::endl;
-    addGroups();
+bool WCMC::load() {
+  if (!m_config.load(m_year, m_mode, m_options.historic, m_options.historicSelection)) return false;
+  m_results.init(m_config);
+
+  // Earlier tournaments are for training, this one (if played) for testing
+  m_config.goalsTest().copyTo(m_h_GoalsData_Test);
+  m_config.goalDiffTest().copyTo(m_h_GoalDiffData_Test);
+  m_config.goalsTraining().copyTo(m_h_GoalsData_Training);
+  m_config.goalDiffTraining().copyTo(m_h_GoalDiffData_Training);
+  if (m_h_GoalsData_Test->Integral() > 0) {
+    m_h_GoalDiffData_Test->Scale( 1. / m_h_GoalDiffData_Test->Integral() );
+    m_h_GoalsData_Test->Scale(1. / m_h_GoalsData_Test->Integral() );
+  }
+  if (m_h_GoalsData_Training->Integral() > 0) {
+    m_h_GoalDiffData_Training->Scale( 1. / m_h_GoalDiffData_Training->Integral() );
+    m_h_GoalsData_Training->Scale(1. / m_h_GoalsData_Training->Integral() );
   }
 
-  execute();
+  const int nTeams = m_config.nTeams();
+  for (int i = 0; i < 6; ++i) { // 5 is a special entry
+    m_h_roundWinner[std::to_string(i)] = new TH1D("", "", nTeams, 0, nTeams);
+  }
+  for (int g = 0; g < m_config.nGroups(); ++g) {
+    for (int position = 0; position < kTeamsPerGroup; ++position) {
+      m_h_roundWinner[m_config.groupLetter(g) + std::to_string(position)] = new TH1D("","", 4, -.5, 3.5);
+    }
+  }
+  return true;
 }
 
-void WCMC::runTraining(float& resultLow, float& resultHigh, const float startLow, const float stopLow, const float startHigh, const float stopHigh, const float step) {
-  m_matchPrint = false;
-  m_matchStats = false;
-  m_goalsScored = false;
-
+void WCMC::runTraining(tuningResult& result, const float startLow, const float stopLow, const float startHigh, const float stopHigh, const float step) {
   TH2F* hTrain;
-  int nBins = (startHigh - stopHigh) / step; 
+  int nBins = (startHigh - stopHigh) / step;
   if (step > 0.05) {
     m_h_trainCorse = new TH2F("TrainC", ";Low;High", nBins+1, startLow, stopLow, nBins+1, stopHigh, startHigh);
-    std::cout << "New training CORSE " << nBins << ", " << startLow << " " << stopLow << ", " << startHigh << " " << stopHigh << std::endl; 
+    LOG_INFO("New training CORSE {}, {} {}, {} {}", nBins, startLow, stopLow, startHigh, stopHigh);
     hTrain = m_h_trainCorse;
   } else {
     m_h_trainFine = new TH2F("TrainF", ";Low;High", nBins, startLow, stopLow, nBins, stopHigh, startHigh);
-    std::cout << "New training FINE " << nBins << ", " << startLow << " " << stopLow << ", " << startHigh << " " << stopHigh << std::endl; 
+    LOG_INFO("New training FINE {}, {} {}, {} {}", nBins, startLow, stopLow, startHigh, stopHigh);
     hTrain = m_h_trainFine;
   }
 
-  float bestChi = 999;
-  for (float trial_goalines_low = startLow; trial_goalines_low < stopLow; trial_goalines_low += step) {
-    for (float trial_goalines_high = startHigh; trial_goalines_high > stopHigh; trial_goalines_high -= step) {
-      if (trial_goalines_high - trial_goalines_low < 1e-2) {
-        //int b =  hTrain->FindBin(trial_goalines_low, trial_goalines_high);
-        //hTrain->SetBinContent(b, 0);
-        continue;
-      }
-      std::cout << std::setprecision(4) << "[" << trial_goalines_low << "," << trial_goalines_high << "] " << std::flush;
-      int seed = 0;
-
-      m_h_GoalsMC->Reset();
-      m_h_GoalDiffMC->Reset();
-      resetTeamStatistics(true);
-
-      int multiplier = 10;
-      int trials = 10000 * multiplier;
-      if (hTrain == m_h_trainFine) trials = 1000 * multiplier;
-
-      for (int trial = 0; trial < trials; ++trial) {
-        R.SetSeed(seed++);
-        for (const std::string& group : group_letters)  doGroup(group, trial_goalines_low, trial_goalines_high);
-      }
-
-      m_h_GoalsMC->Scale( 1./m_h_GoalsMC->Integral() );
-      m_h_GoalDiffMC->Scale( 1./m_h_GoalDiffMC->Integral() );
-
-      const float goodnessA = m_h_GoalsData_Training->Chi2Test(m_h_GoalsMC, "NORM  UU CHI2/NDF");
-      const float goodnessB = m_h_GoalDiffData_Training->Chi2Test(m_h_GoalDiffMC, "NORM  UU CHI2/NDF");
-
-      int b =  hTrain->FindBin(trial_goalines_low, trial_goalines_high);
-      hTrain->SetBinContent(b, goodnessA+goodnessB);
-      //std::cout << std::endl << "Fill bin " << trial_goalines_low << "," << trial_goalines_high << " = " << b << " to " << goodnessA+goodnessB << std::endl;
-
-      if ( goodnessA + goodnessB < bestChi) {
-        bestChi = goodnessA + goodnessB;
-        //m_bestChiG_Test  = m_h_GoalsData_Test->Chi2Test(m_h_GoalsMC, "NORM  UU CHI2/NDF");
-        //m_bestChiGD_Test = m_h_GoalDiffData_Test->Chi2Test(m_h_GoalDiffMC, "NORM  UU CHI2/NDF");
-        m_bestChiG_Training = goodnessA;
-        m_bestChiGD_Training = goodnessB;
-        resultLow = trial_goalines_low;
-        resultHigh = trial_goalines_high;
-        std::cout << "--- Chi2 of:" << goodnessA + goodnessB << " for Low:" << resultLow << " High:" << resultHigh << std::endl;
-      }
-    }
+  const int multiplier = 10;
+  const int trials = (hTrain == m_h_trainFine ? 1000 : 10000) * multiplier;
+  m_progress.phase = "training";
+  m_progress.phaseStart = std::chrono::steady_clock::now();
+  m_progress.trialsDone = m_progress.trialsTotal = 0;
+  m_progress.tuningChi2 = -1;
+
+  tune(m_config, tuningGrid{startLow, stopLow, startHigh, stopHigh, step, trials}, result, [this](const tuningResult& progress) {
+    if (!m_snapshot.due()) return;
+    m_progress.trialsDone = progress.trialsDone;
+    m_progress.trialsTotal = progress.trialsTotal;
+    if (progress.chi2() >= 0) {
+      m_progress.tuningLow = progress.low;
+      m_progress.tuningHigh = progress.high;
+      m_progress.tuningChi2 = progress.chi2();
+    }
+    publishProgress();
+  });
+  for (const tuningPoint& point : result.points) {
+    int b =  hTrain->FindBin(point.low, point.high);
+    hTrain->SetBinContent(b, point.chi2);
   }
-  std::cout << "chi2 when using the Training tuning dataset: G=" << m_bestChiG_Training << " GD=" << m_bestChiGD_Training << std::endl;
-  std::cout << "chi2 against the Test dataset: G=" << m_bestChiG_Test << " GD=" << m_bestChiGD_Test << std::endl;
-}
 
-const std::string WCMC::getWinningTeam(const std::string group) {
-  int winningPoints = -1, winningGD = -1, winningGoals = -1, winningRank = 999;
-  std::string winningTeam;
-  for (auto& team : m_groups[group]) {
-    bool better = false;
-    if ( m_teams[team].m_points > winningPoints ) better = true;
-    else if ( m_teams[team].m_points == winningPoints) {
-      if (m_teams[team].m_goalDiff > winningGD) better = true;
-      else if (m_teams[team].m_goals > winningGoals) better = true;
-      else if (m_teams[team].m_rank < winningRank) better = true; // This is not according to FIFA rules
-    }
-    if (better) { // TODO use a dummy Team for this
-      winningPoints = m_teams[team].m_points;
-      winningGD = m_teams[team].m_goalDiff;
-      winningRank = m_teams[team].m_rank;
-      winningGoals = m_teams[team].m_goals;
-      winningTeam = team;
-    }
-  }
-  return winningTeam;
+  m_tuning.chi2G_Training = result.chi2G_Training;
+  m_tuning.chi2GD_Training = result.chi2GD_Training;
+  m_tuning.chi2G_Test = result.chi2G_Test;
+  m_tuning.chi2GD_Test = result.chi2GD_Test;
+  m_progress.trialsDone = result.trialsDone;
+  m_progress.tuningLow = result.low;
+  m_progress.tuningHigh = result.high;
+  m_progress.tuningChi2 = result.chi2();
+  logger::get().flush();
 }
 
-void WCMC::runFinal(const float goalinessLow, const float goalinessHigh) {
-  int seed = 0;
-  m_h_GoalsMC->Reset();
-  m_h_GoalDiffMC->Reset();
-  m_goalsScored = true;
-  bool firstEnglandWin = true;
-  std::map<std::string, int> outcomes;
-  std::map<std::string, int> outcomesToQuarter;
-  std::map<std::string, int> outcomesToSemi;
-
-  for (int trial = 0; trial < m_trialsMax; ++ trial) {
-    m_matchPrint = (trial == m_trialsMax-1);
-    R.SetSeed(seed++);
-
-    std::set<std::string> dropOutAt16;
-    std::set<std::string> dropOutAtQuarter;
-    std::set<std::string> dropOutAtSemi;
-
-    resetTeamStatistics(true);
-    resetLaterGroups();
-
-    if (m_mode == kFULL_TOURNAMENT) {
-      m_matchStats = true;
-      for (const std::string& group : group_letters)  {
-        doGroup(group, goalinessLow, goalinessHigh);
-        std::string teamPlace[4];
-        for (int position = 0; position < 4; ++position) {
-          teamPlace[position] = getWinningTeam(group);  
-          m_teams[teamPlace[position]].m_points = -1; // Take out of action to get the next one
-          m_h_roundWinner[group+std::to_string(position)]->Fill( std::distance(m_groups[group].begin(), std::find(m_groups[group].begin(), m_groups[group].end(), teamPlace[position])) );
-        }
-        if (m_matchPrint) std::cout << "Winner of group " << group << ":" << teamPlace[0] << ", runner up " << teamPlace[1] << std::endl;
-        m_h_roundWinner["0"]->Fill( m_teams[teamPlace[0]].m_index + 0.5 );
-        m_h_roundWinner["0"]->Fill( m_teams[teamPlace[1]].m_index + 0.5 );
-        if (group == "A") {
-          m_groups["49"].push_back(teamPlace[0]);
-          m_groups["51"].push_back(teamPlace[1]);
-        } else if (group == "B") {
-          m_groups["51"].push_back(teamPlace[0]);
-          m_groups["49"].push_back(teamPlace[1]);
-        } else if (group == "C") {
-          m_groups["50"].push_back(teamPlace[0]);
-          m_groups["52"].push_back(teamPlace[1]);
-        } else if (group == "D") {
-          m_groups["52"].push_back(teamPlace[0]);
-          m_groups["50"].push_back(teamPlace[1]);
-        } else if (group == "E") {
-          m_groups["53"].push_back(teamPlace[0]);
-          m_groups["55"].push_back(teamPlace[1]);
-        } else if (group == "F") {
-          m_groups["55"].push_back(teamPlace[0]);
-          m_groups["53"].push_back(teamPlace[1]);
-        } else if (group == "G") {
-          m_groups["54"].push_back(teamPlace[0]);
-          m_groups["56"].push_back(teamPlace[1]);
-        } else if (group == "H") {
-          m_groups["56"].push_back(teamPlace[0]);
-          m_groups["54"].push_back(teamPlace[1]);
-        }
-      }
-    }
-    m_matchStats = false;
-
-    if (m_mode == kAFTER_GROUP) {
-      m_matchStats = true;
-      for ( size_t t = 0; t < m_laterRoundTeams.size(); ++t ) {
-        switch (t) {
-          case 0: case 3:   m_groups["49"].push_back(m_laterRoundTeams.at(t)); break;
-          case 1: case 2:   m_groups["51"].push_back(m_laterRoundTeams.at(t)); break; 
-          case 4: case 7:   m_groups["50"].push_back(m_laterRoundTeams.at(t)); break; 
-          case 5: case 6:   m_groups["52"].push_back(m_laterRoundTeams.at(t)); break; 
-          case 8: case 11:  m_groups["53"].push_back(m_laterRoundTeams.at(t)); break;
-          case 9: case 10:  m_groups["55"].push_back(m_laterRoundTeams.at(t)); break;
-          case 12: case 15: m_groups["54"].push_back(m_laterRoundTeams.at(t)); break;
-          case 13: case 14: m_groups["56"].push_back(m_laterRoundTeams.at(t)); break;
-        }
-      }
-    }
-
-    if (m_mode < kAFTER_16) {
-      resetTeamStatistics(false);
-      for (int m = 49; m < 57; ++m) {
-        doGroup(std::to_string(m), goalinessLow, goalinessHigh);
-        const std::string winning = getWinningTeam(std::to_string(m));
-        if (m_matchPrint) std::cout << "Winner of round " << m << ":" << winning << std::endl;
-        m_h_roundWinner["1"]->Fill( m_teams[winning].m_index + 0.5 ); // Many entries here, so we offset the axis ticks
-        m_teams[winning].m_points = -1; // Disable to get runner up
-        const std::string dropOut = getWinningTeam(std::to_string(m));
-        dropOutAt16.insert( m_teamToAbrieviation[dropOut] );
-        switch (m) {
-          case 49: case 50: m_groups["57"].push_back(winning); break;
-          case 51: case 52: m_groups["59"].push_back(winning); break;
-          case 53: case 54: m_groups["58"].push_back(winning); break;
-          case 55: case 56: m_groups["60"].push_back(winning); break;
-        }
-      }
+bool WCMC::runFinal() {
+  PROFILE_SCOPE("runFinal");
+  const float goalinessLow = m_tuning.low, goalinessHigh = m_tuning.high;
+  if (!m_options.trialStore.empty()) {
+    if (m_config.nTeams() > (int)kStoreMaxTeams) {
+      std::cout << "Error. A trial store holds at most " << kStoreMaxTeams << " teams, " << m_year << " has " << m_config.nTeams() << std::endl;
+      return false;
     }
-    m_matchStats = false;
-
-    if (m_mode == kAFTER_16) {
-      m_matchStats = true;
-      for ( size_t t = 0; t < m_laterRoundTeams.size(); ++t ) {
-        switch (t) {
-          case 0: case 1: m_groups["57"].push_back(m_laterRoundTeams.at(t)); break;
-          case 2: case 3: m_groups["59"].push_back(m_laterRoundTeams.at(t)); break; 
-          case 4: case 5: m_groups["58"].push_back(m_laterRoundTeams.at(t)); break; 
-          case 6: case 7: m_groups["60"].push_back(m_laterRoundTeams.at(t)); break; 
-        }
-      }
-    }
-
-    if (m_mode < kAFTER_QUARTER) {
-      resetTeamStatistics(false);
-      for (int m = 57; m < 61; ++m) {
-        doGroup(std::to_string(m), goalinessLow, goalinessHigh);
-        const std::string winning = getWinningTeam(std::to_string(m));
-        if (m_matchPrint) std::cout << "Winner of QF match " << m << ":" << winning << std::endl;
-        m_h_roundWinner["2"]->Fill( m_teams[winning].m_index + 0.5 );
-        m_teams[winning].m_points = -1; // Disable to get runner up
-        const std::string dropOut = getWinningTeam(std::to_string(m));
-        dropOutAtQuarter.insert( m_teamToAbrieviation[dropOut] );
-        switch (m) {
-          case 57: case 58: m_groups["61"].push_back(winning); break;
-          case 59: case 60: m_groups["62"].push_back(winning); break;
-        }
-      }
-    }
-    m_matchStats = false;
-
-    if (m_mode == kAFTER_QUARTER) {
-      m_matchStats = true;
-      for ( size_t t = 0; t < m_laterRoundTeams.size(); ++t ) {
-        switch (t) {
-          case 0: case 1: m_groups["61"].push_back(m_laterRoundTeams.at(t)); break;
-          case 2: case 3: m_groups["62"].push_back(m_laterRoundTeams.at(t)); break; 
-        }
-      }
-    }
-
-    std::string finalistA, finalistB, runnerUpA, runnerUpB;
-    if (m_mode < kAFTER_SEMI) {
-      resetTeamStatistics(false);
-      doGroup("61", goalinessLow, goalinessHigh);
-      finalistA = getWinningTeam("61");
-      m_teams[finalistA].m_points = -1; // Disable to get runner up
-      runnerUpA = getWinningTeam("61");
-      dropOutAtSemi.insert( m_teamToAbrieviation[runnerUpA] );
-      m_groups["63"].push_back(runnerUpA); // Runner up
-      doGroup("62", goalinessLow, goalinessHigh);
-      finalistB = getWinningTeam("62");
-      m_teams[finalistB].m_points = -1; // Disable to get runner up
-      runnerUpB = getWinningTeam("62");
-      dropOutAtSemi.insert( m_teamToAbrieviation[runnerUpB] );
-      m_groups["63"].push_back(runnerUpB); // Runner up
-      m_h_roundWinner["3"]->Fill( m_teams[finalistA].m_index + 0.5 ); 
-      m_h_roundWinner["3"]->Fill( m_teams[finalistB].m_index + 0.5 );
-    }
-    m_matchStats = false;
-
-    if (m_mode == kAFTER_SEMI) {
-      m_matchStats = true;
-      finalistA = m_laterRoundTeams.at(0);
-      finalistB = m_laterRoundTeams.at(1);
-      m_groups["63"].push_back(m_laterRoundTeams.at(2));
-      m_groups["63"].push_back(m_laterRoundTeams.at(3));
-    }
-
-    resetTeamStatistics(false);
-    m_groups["64"].push_back(finalistA);
-    m_groups["64"].push_back(finalistB);
-    doGroup("63", goalinessLow, goalinessHigh);
-    const std::string thirdPlace = getWinningTeam("63");
-    m_teams[thirdPlace].m_points = -1; // Disable to get 4th place
-    const std::string fourthPlace = getWinningTeam("63");
-    //
-    doGroup("64", goalinessLow, goalinessHigh);
-    const std::string winnerWinner = getWinningTeam("64");
-    m_teams[winnerWinner].m_points = -1; // Disable to get 2th place
-    const std::string secondPlace = getWinningTeam("64");
-    m_h_roundWinner["4"]->Fill( m_teams[winnerWinner].m_index + 0.5 );
-    if (m_matchPrint || trial % 10000 == 0) std::cout << "Trial:" << trial 
-      << " 4th place:" << fourthPlace << " 3rd place:" << thirdPlace << ". Winners of SFs " <<  finalistA << " & " << finalistB 
-      << ", WINNER WINNER:" << winnerWinner 
-      << std::endl << " ----------------- " << std::endl;
-
-    std::stringstream ss;
-    ss << m_teamToAbrieviation[winnerWinner] << "/"
-      << m_teamToAbrieviation[secondPlace] << "/";
-    int i = 0;
-    for (const std::string& s : dropOutAtSemi) {
-      ss << s;
-      if (++i < 2) ss << "_";
-    }
-
-    outcomesToSemi[ ss.str() ]++;
-
-    ss << "/";
-    i = 0;
-    for (const std::string& s : dropOutAtQuarter) {
-      ss << s;
-      if (++i < 4) ss << "_";
-    }
-
-    outcomesToQuarter[ ss.str() ]++;
-
-    ss << "/";
-    i = 0;
-    for (const std::string& s : dropOutAt16) {
-      ss << s;
-      if (++i < 8) ss << "_";
-    }
-
-    outcomes[ ss.str() ]++;
-
-    if (firstEnglandWin && winnerWinner == "England") {
-      std::cout << std::endl << std::endl << "1st England win on trial " << trial << " " << ss.str() << std::endl << std::endl;
-      firstEnglandWin = false;
-    }
-
+    if (!openTrialStore()) return false;
   }
 
-  m_h_GoalsMC->Scale( 1./m_h_GoalsMC->Integral() );
-  m_h_GoalDiffMC->Scale( 1./m_h_GoalDiffMC->Integral() );
-
-  if (m_mode == kAFTER_QUARTER) return;
-
-  std::cout << "Outcomes to semi size is " << outcomesToSemi.size() << std::endl;
-
-  // Find most current outcomes
-  int iterations = 0;
-  int print = 0;
-  while (outcomesToSemi.size()) {
-    // Find
-    int highestScore = 0;
-    for (auto const& [key, val] : outcomesToSemi) {
-      if (val > highestScore) {
-        highestScore = val;
-      }
-    }
-    // Extract
-    std::vector<std::string> outcomesWithScore;
-    for (auto const& [key, val] : outcomesToSemi) {
-      if (val == highestScore) {
-        outcomesWithScore.push_back(key);
-      }
-    }
-    // Erase & report
-    bool doPrint = outcomesWithScore.size() <= 20 && ++print < 20;
-    if (!doPrint && outcomesWithScore.size() > 1) std::cout << "Most common outcome (to semi) #" << ++iterations << ": with " << highestScore << " instances has " << outcomesWithScore.size() << " members" << std::endl;
-    for (const std::string& s : outcomesWithScore) {
-      outcomesToSemi.erase(s);
-      if (doPrint) std::cout << "Most common outcome (to semi) #" << ++iterations << ": with " << highestScore << " instances = " << s << std::endl;
-    }
+  // Each trial is seeded by its index, so shards and threads of the same campaign reproduce a single run exactly
+  const uint64_t first = (uint64_t)m_trialsMax * m_options.shard / m_options.shards;
+  const uint64_t last = (uint64_t)m_trialsMax * (m_options.shard + 1) / m_options.shards;
+  int nThreads = (m_options.threads > 0 ? m_options.threads : std::max(std::thread::hardware_concurrency(), 1u));
+  if (m_trialWriter != nullptr) nThreads = 1; // The store is written in trial order
+  m_progress.phase = "simulation";
+  m_progress.phaseStart = std::chrono::steady_clock::now();
+  m_progress.trialsDone = 0;
+  m_progress.trialsTotal = last - first;
+  m_progress.tuningLow = goalinessLow;
+  m_progress.tuningHigh = goalinessHigh;
+  m_progress.tuningChi2 = (m_tuning.chi2G_Training < 0 ? -1 : m_tuning.chi2G_Training + m_tuning.chi2GD_Training);
+  m_threadProgress.assign(nThreads, threadProgress());
+
+  std::vector<std::unique_ptr<tournamentRun>> runs;
+  for (int t = 0; t < nThreads; ++t) runs.emplace_back(new tournamentRun(m_config));
+  if (m_trialWriter != nullptr) runs.at(0)->setTrialRecord(&m_trialRecord);
+  std::atomic<int> running(nThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      simulateTrials(*runs[t], t, first + (last - first) * t / nThreads, first + (last - first) * (t + 1) / nThreads, goalinessLow, goalinessHigh);
+      --running;
+    });
   }
-
-  if (m_mode == kAFTER_16) return;
-
-  std::cout << "Outcomes to quarter size is " << outcomesToQuarter.size() << std::endl;
-
-  // Find most current outcomes
-  iterations = 0;
-  print = 0;
-  while (outcomesToQuarter.size()) {
-    // Find
-    int highestScore = 0;
-    for (auto const& [key, val] : outcomesToQuarter) {
-      if (val > highestScore) {
-        highestScore = val;
-      }
-    }
-    // Extract
-    std::vector<std::string> outcomesWithScore;
-    for (auto const& [key, val] : outcomesToQuarter) {
-      if (val == highestScore) {
-        outcomesWithScore.push_back(key);
-      }
-    }
-    // Erase & report
-    bool doPrint = outcomesWithScore.size() <= 20 && ++print < 20;
-    if (!doPrint && outcomesWithScore.size() > 1) std::cout << "Most common outcome (to quarter) #" << ++iterations << ": with " << highestScore << " instances has " << outcomesWithScore.size() << " members" << std::endl;
-    for (const std::string& s : outcomesWithScore) {
-      outcomesToQuarter.erase(s);
-      if (doPrint) std::cout << "Most common outcome (to quarter) #" << ++iterations << ": with " << highestScore << " instances = " << s << std::endl;
-    }
+  while (!m_options.snapshot.empty() && running.load() > 0) {
+    if (m_snapshot.due()) publishProgress();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  for (std::thread& thread : threads) thread.join();
+  logger::get().flush();
+
+  m_results.reset();
+  for (const std::unique_ptr<tournamentRun>& run : runs) m_results.add(run->results());
+  if (!m_options.snapshot.empty()) publishProgress(); // The final counts, written when the snapshot stops
+  m_snapshot.stop();
+  fillHistograms();
+
+  if (m_trialWriter != nullptr) {
+    const uint64_t trials = m_trialWriter->trials();
+    const bool written = m_trialWriter->close();
+    delete m_trialWriter;
+    m_trialWriter = nullptr;
+    if (written) std::cout << "Wrote " << trials << " trials to " << m_options.trialStore << std::endl;
+    if (written && m_options.shards == 1) queryTrialStore(m_options.trialStore, m_options.queries);
   }
 
-  if (m_mode == kAFTER_GROUP) return;
-
-  std::cout << "Outcomes size is " << outcomes.size() << std::endl;
+  if (m_options.shards > 1) {
+    writePartial(first, last);
+    return true;
+  }
+  reportOutcomes();
+  return true;
+}
 
-  // Find most current outcomes
-  iterations = 0;
-  print = 0;
-  while (outcomes.size()) {
-    // Find
-    int highestScore = 0;
-    for (auto const& [key, val] : outcomes) {
-      if (val > highestScore) {
-        highestScore = val;
-      }
-    }
-    // Extract
-    std::vector<std::string> outcomesWithScore;
-    for (auto const& [key, val] : outcomes) {
-      if (val == highestScore) {
-        outcomesWithScore.push_back(key);
-      }
-    }
-    // Erase & report
-    bool doPrint = outcomesWithScore.size() <= 20 && ++print < 20;
-    if (!doPrint && outcomesWithScore.size() > 1) std::cout << "Most common outcome #" << ++iterations << ": with " << highestScore << " instances has " << outcomesWithScore.size() << " members" << std::endl;
-    for (const std::string& s : outcomesWithScore) {
-      outcomes.erase(s);
-      if (doPrint) std::cout << "Most common outcome #" << ++iterations << ": with " << highestScore << " instances = " << s << std::endl;
+// Trials [first, last) on one thread
+void WCMC::simulateTrials(tournamentRun& run, const int thread, const uint64_t first, const uint64_t last, const float goalinessLow, const float goalinessHigh) {
+  const trialOutcome& outcome = run.outcome();
+  const int england = m_config.teamIndex("England");
+  bool firstEnglandWin = (thread == 0); // Only the first thread plays its trials in order from the start
+  const bool snapshot = !m_options.snapshot.empty(); // Nothing reads the shared progress without one
+  for (uint64_t trial = first; trial < last; ++ trial) {
+    const bool matchPrint = (trial == m_trialsMax-1);
+    if (matchPrint) logger::get().flush(); // The match printout goes straight to std::cout
+    run.playTrial(trial, goalinessLow, goalinessHigh, matchPrint);
+    if (snapshot && (trial - first + 1) % kProgressTrials == 0) shareProgress(thread, run);
+    if (matchPrint || trial % 10000 == 0) LOG_INFO("Trial:{} 4th place:{} 3rd place:{}. Winners of SFs {} & {}, WINNER WINNER:{}\n ----------------- ",
+      trial, m_config.team(outcome.fourth).name, m_config.team(outcome.third).name, m_config.team(outcome.finalistA).name,
+      m_config.team(outcome.finalistB).name, m_config.team(outcome.winner).name);
+
+    if (m_trialWriter != nullptr) {
+      m_trialWriter->append(m_trialRecord);
+      continue; // Outcomes are answered by querying the store
+    }
+
+    const std::string& key = run.recordOutcome();
+    if (firstEnglandWin && outcome.winner == england) {
+      LOG_INFO("\n\n1st England win on trial {} {}\n", trial, key);
+      firstEnglandWin = false;
     }
   }
+  if (snapshot) shareProgress(thread, run);
+}
 
+void WCMC::reportOutcomes() {
+  m_h_GoalsMC->Scale( 1./m_h_GoalsMC->Integral() );
+  m_h_GoalDiffMC->Scale( 1./m_h_GoalDiffMC->Integral() );
+  PROFILE_MAX("Match result histograms", m_h_matchResult.size());
+  printOutcomes(m_results, m_mode);
+}
 
+std::string WCMC::partialFileName() {
+  if (!m_options.partial.empty()) return m_options.partial;
+  return "WCMC_partial_" + std::to_string(m_options.shard) + "_of_" + std::to_string(m_options.shards) + ".bin";
+}
 
+bool WCMC::writePartial(const uint64_t first, const uint64_t last) {
+  partialHeader header;
+  memset(&header, 0, sizeof(header));
+  header.mode = m_mode;
+  header.year = m_year;
+  header.shard = m_options.shard;
+  header.shards = m_options.shards;
+  header.first = first;
+  header.last = last;
+  header.totalTrials = m_trialsMax;
+  header.goalinessLow = m_tuning.low;
+  header.goalinessHigh = m_tuning.high;
+  header.chiG_Training = m_tuning.chi2G_Training;
+  header.chiGD_Training = m_tuning.chi2GD_Training;
+  return ::writePartial(partialFileName(), header, m_config, m_results);
+}
 
+// The shards' results, tuning and training chi2 in place of runTraining and runFinal
+bool WCMC::mergePartials() {
+  partialHeader header;
+  if (!::mergePartials(m_options.merge, m_config, m_results, header)) return false;
+  m_tuning.low = header.goalinessLow;
+  m_tuning.high = header.goalinessHigh;
+  m_tuning.chi2G_Training = header.chiG_Training;
+  m_tuning.chi2GD_Training = header.chiGD_Training;
+  m_trialsMax = m_results.trials;
+  fillHistograms();
+  return true;
 }
 
 void WCMC::execute() {
-  std::cout << "Execute with mode " << (int)m_mode << std::endl;
-  float resultLowFine, resultHighFine;
-  
-  const bool reTrain = false;
+  PROFILE_SCOPE("execute");
+  std::cout << "Execute with mode " << (int)m_mode << " for " << m_year << std::endl;
+
+  const bool merging = !m_options.merge.empty();
+  tuningResult tuning;
+  const bool reTrain = !knownTuning(m_year, tuning) && !merging; // Merged shards bring their tuning
+  m_tuning.low = tuning.low;
+  m_tuning.high = tuning.high;
+  m_tuning.chi2G_Training = tuning.chi2G_Training;
+  m_tuning.chi2GD_Training = tuning.chi2GD_Training;
+  if (!m_options.snapshot.empty()) m_snapshot.start(m_options.snapshot, m_options.snapshotInterval);
 
   if (reTrain == true && m_mode != kFULL_TOURNAMENT) {
     std::cout << "Error. Can only train when m_mode = kFULL_TOURNAMENT";
@@ -694,41 +468,109 @@ void WCMC::execute() {
   }
 
   if (reTrain) {
-    float resultLowCorse, resultHighCorse;
-    runTraining(resultLowCorse, resultHighCorse, 0.1, 5.0, 5.0, 0.1, /*step*/0.1);
-    runTraining(resultLowFine, resultHighFine, resultLowCorse - 0.5, resultLowCorse + 0.5, resultHighCorse + 0.5, resultHighCorse - 0.5, /*step*/0.01);
-    std::cout << " ---->>>>> Tuned Low: "<< resultLowFine << " High: " << resultHighFine << "(Best chi2 G:" << m_bestChiG_Training << ", GD:" << m_bestChiGD_Training << ")" << std::endl;
- 
-    nicePlot* npC = new nicePlot();
-    npC->setLogz(true);
-    npC->init("Goaliness Lower", "Goaliness Upper", "#chi^{2}/DoF");
-    npC->setRBounds(1.5, m_h_trainCorse->GetMaximum() * 1.01);
-    npC->add2D(m_h_trainCorse);
-
-    nicePlot* npF = new nicePlot();
-    npF->setLogz(false);
-    npF->init("Goaliness Lower", "Goaliness Upper", "#chi^{2}/DoF");
-    npF->setRBounds(2.45, 3.45);
-    npF->add2D(m_h_trainFine);
-
-    bookOutput::get().doBookOutput("WCMC_TuningGrid");
-    bookOutput::clear();
-
+    tuningResult corse;
+    runTraining(corse, 0.1, 5.0, 5.0, 0.1, /*step*/0.1);
+    runTraining(tuning, corse.low - 0.5, corse.low + 0.5, corse.high + 0.5, corse.high - 0.5, /*step*/0.01);
+    m_tuning.low = tuning.low;
+    m_tuning.high = tuning.high;
+    std::cout << " ---->>>>> Tuned Low: "<< m_tuning.low << " High: " << m_tuning.high << "(Best chi2 G:" << m_tuning.chi2G_Training << ", GD:" << m_tuning.chi2GD_Training << ")" << std::endl;
+    if (m_options.plots) {
+      nicePlot* npC = new nicePlot();
+      npC->setLogz(true);
+      npC->init("Goaliness Lower", "Goaliness Upper", "#chi^{2}/DoF");
+      npC->setRBounds(1.5, m_h_trainCorse->GetMaximum() * 1.01);
+      npC->add2D(m_h_trainCorse);
+
+      nicePlot* npF = new nicePlot();
+      npF->setLogz(false);
+      npF->init("Goaliness Lower", "Goaliness Upper", "#chi^{2}/DoF");
+      npF->setRBounds(2.45, 3.45);
+      npF->add2D(m_h_trainFine);
+
+      bookOutput::get().doBookOutput("WCMC_TuningGrid");
+      bookOutput::clear();
+    }
+  }
+  if (merging) {
+    if (!mergePartials()) return;
+    reportOutcomes();
   } else {
-    // 2022
-    resultLowFine = 1.53;
-    resultHighFine = 1.54;
-    m_bestChiG_Training = 1.594;
-    m_bestChiGD_Training = 0.8898;
+    if (!runFinal()) return;
+    if (m_options.shards > 1) return; // Reporting and plots come from --merge
+  }
 
-    // 2018
-    //resultLowFine = 1.52;
-    //resultHighFine = 1.79;
-    //m_bestChiG_Training = 1.03463;
-    //m_bestChiGD_Training = 0.616308;
+  if (m_mode == kFULL_TOURNAMENT && m_config.goalsTest().integral() > 0) { // All 64 games against this year's results
+    m_tuning.chi2G_Test  = chi2PerDof(m_config.goalsTest(), m_results.goals);
+    m_tuning.chi2GD_Test = chi2PerDof(m_config.goalDiffTest(), m_results.goalDiff);
+    std::cout << "chi2 against the " << m_year << " Test dataset: G=" << m_tuning.chi2G_Test << " GD=" << m_tuning.chi2GD_Test << std::endl;
   }
-  runFinal(resultLowFine, resultHighFine);
+  scoreForecast(m_config, m_results, m_scorer);
 
+  if (!m_options.results.empty()) writeResults(m_options.results, m_config, m_results, m_tuning);
+  if (m_options.rootOutput) {
+    writeRootFile(m_options.rootFile.empty() ? "WCMC_" + std::to_string(m_year) + "_Mode" + std::to_string((int)m_mode) + ".root" : m_options.rootFile);
+  }
+  if (!m_options.report.empty()) writeReport(m_options.report, m_config, m_results);
+  if (m_options.plots) plotResults();
+}
+
+// The raw (unnormalised) histograms the plots and results are made from, written once at the end of the run.
+// Under a wc<year>_mode<m> directory:
+//   training  Tuning grids (if retrained) and the training data
+//   goals     Simulated and test goal distributions
+//   group     Group finishing positions (position_<group><n>) and group game score matrices (<teamA>_<teamB>)
+//   knockout  Knockout game score matrices
+//   rounds    Teams reaching each round (0-4), 5 is goals scored per team
+bool WCMC::writeRootFile(const std::string& fname) {
+  TFile* f = TFile::Open(fname.c_str(), "RECREATE", "WCMC", 505); // ZSTD level 5
+  if (f == nullptr || f->IsZombie()) {
+    std::cout << "Error. Cannot write ROOT output " << fname << std::endl;
+    delete f;
+    return false;
+  }
+  TDirectory* scenario = f->mkdir(("wc" + std::to_string(m_year) + "_mode" + std::to_string((int)m_mode)).c_str());
+  TDirectory* training = scenario->mkdir("training");
+  TDirectory* goals = scenario->mkdir("goals");
+  TDirectory* group = scenario->mkdir("group");
+  TDirectory* knockout = scenario->mkdir("knockout");
+  TDirectory* rounds = scenario->mkdir("rounds");
+
+  if (m_h_trainCorse != nullptr) training->WriteTObject(m_h_trainCorse, "TrainCoarse");
+  if (m_h_trainFine != nullptr) training->WriteTObject(m_h_trainFine, "TrainFine");
+  // The goal histograms are normalised for the plots by now, so write copies filled from the counts
+  const auto writeCounts = [](TDirectory* dir, const binCounts& counts, const TH1* binning, const char* name) {
+    TH1* h = (TH1*) binning->Clone();
+    counts.copyTo(h);
+    dir->WriteTObject(h, name);
+    delete h;
+  };
+  writeCounts(training, m_config.goalsTraining(), m_h_GoalsData_Training, "GoalsData_Training");
+  writeCounts(training, m_config.goalDiffTraining(), m_h_GoalDiffData_Training, "GoalDiffData_Training");
+  writeCounts(goals, m_results.goals, m_h_GoalsMC, "GoalsMC");
+  writeCounts(goals, m_results.goalDiff, m_h_GoalDiffMC, "GoalDiffMC");
+  writeCounts(goals, m_config.goalsTest(), m_h_GoalsData_Test, "GoalsData_Test");
+  writeCounts(goals, m_config.goalDiffTest(), m_h_GoalDiffData_Test, "GoalDiffData_Test");
+
+  std::map<std::string, std::string> groupOf;
+  for (int g = 0; g < m_config.nGroups(); ++g) for (const int team : m_config.group(g)) groupOf[m_config.team(team).name] = m_config.groupLetter(g);
+  for (const auto& [key, h] : m_h_matchResult) {
+    const size_t split = key.find('_');
+    const bool groupGame = groupOf.count(key.substr(0, split)) && groupOf[key.substr(0, split)] == groupOf[key.substr(split + 1)];
+    (groupGame ? group : knockout)->WriteTObject(h, key.c_str());
+  }
+  for (const auto& [key, h] : m_h_roundWinner) {
+    if (key.size() == 1 && isdigit(key[0])) rounds->WriteTObject(h, key.c_str());
+    else group->WriteTObject(h, ("position_" + key).c_str());
+  }
+
+  f->Close();
+  delete f;
+  std::cout << "Wrote ROOT output to " << fname << std::endl;
+  return true;
+}
+
+void WCMC::plotResults() {
+  PROFILE_SCOPE("Plot export");
   int numberOfPassingTeams = 16;
   for (int i=0; i < (int)m_mode; ++i) numberOfPassingTeams /= 2;
   unsigned start = 0, end = 0; // Used mid-tournament
@@ -747,33 +589,35 @@ void WCMC::execute() {
   np_base->setLogz(true);
   np_base->normaliseToOne();
   if (m_mode == kFULL_TOURNAMENT) { // Group stage games
-    const unsigned groupSize = m_groups["A"].size();
-    for (unsigned i = 0; i < groupSize - 1; ++i) {
-      for (unsigned j = i + 1; j < groupSize; ++j) {
-        for (const std::string& group : group_letters) {
-          const std::vector<std::string>& teams = m_groups.at(group);
+    for (unsigned i = 0; i < kTeamsPerGroup - 1; ++i) {
+      for (unsigned j = i + 1; j < kTeamsPerGroup; ++j) {
+        for (int g = 0; g < m_config.nGroups(); ++g) {
+          const std::string& teamA = m_config.team(m_config.group(g).at(i)).name;
+          const std::string& teamB = m_config.team(m_config.group(g).at(j)).name;
           nicePlot* np = new nicePlot(np_base);
-          np->init(teams.at(i) + " Goals", teams.at(j) + " Goals", "");
-          TH2* h = m_h_matchResult[teams.at(i) + "_" + teams.at(j)];
+          np->init(teamA + " Goals", teamB + " Goals", "");
+          TH2* h = getMatchResult(teamA + "_" + teamB);
           np->add2D(h);
           int maxX = -1, maxY = -1, maxZ = -1;
           h->GetBinXYZ(h->GetMaximumBin(), maxX, maxY, maxZ);
-          np->addLable(.5, .75, teams.at(i) + ": " + std::to_string( maxX - 1 ));
-          np->addLable(.5, .80, teams.at(j) + ": " + std::to_string( maxY - 1 ));
-          np->addLable(.5, .85, "Group: " + group);
+          np->addLable(.5, .75, teamA + ": " + std::to_string( maxX - 1 ));
+          np->addLable(.5, .80, teamB + ": " + std::to_string( maxY - 1 ));
+          np->addLable(.5, .85, "Group: " + m_config.groupLetter(g));
         }
       }
     }
-    bookOutput::setBreak(group_letters.size());
+    bookOutput::setBreak(m_config.nGroups());
     bookOutput::get().doMultipadOutput("WCMC_GroupStage", 3, 2);
     bookOutput::clear();
   } else if (m_mode >= kAFTER_GROUP) { // Knockout games
     for (unsigned i = start; i < end; ++i) {
-      const std::string teamA = m_groups[std::to_string(i)].at(0);
-      const std::string teamB = m_groups[std::to_string(i)].at(1);
+      const std::vector<int>& seeds = m_config.knockoutSeeds(i); // The teams of the pass file, known without a trial
+      if (seeds.size() < 2) continue;
+      const std::string& teamA = m_config.team(seeds.at(0)).name;
+      const std::string& teamB = m_config.team(seeds.at(1)).name;
       nicePlot* np = new nicePlot(np_base);
       np->init(teamA + " Goals", teamB + " Goals", "");
-      TH2* h = m_h_matchResult[teamA + "_" + teamB];
+      TH2* h = getMatchResult(teamA + "_" + teamB);
       np->add2D(h);
       int maxX = -1, maxY = -1, maxZ = -1;
       h->GetBinXYZ(h->GetMaximumBin(), maxX, maxY, maxZ);
@@ -792,22 +636,22 @@ void WCMC::execute() {
   np_base_1d->setBounds(-.5, 8.5, 0.001, .85, 0., 2.);
   nicePlot* np_tuneGoals = new nicePlot(np_base_1d);
   np_tuneGoals->init("Total Goals", "Probability", "MC/Data");
-  np_tuneGoals->addData(m_h_GoalsData_Training, "Data 14+18", 0, false);
+  np_tuneGoals->addData(m_h_GoalsData_Training, "Data " + m_config.trainingLabel(), 0, false);
   np_tuneGoals->addMC(m_h_GoalsMC, "MC", true, 0.);
-  //np_tuneGoals->addData(m_h_GoalsData_Test, "Data 2022", 0, false);
-  np_tuneGoals->addLable(0.2,0.70, "Goaliness Low: " + std::to_string(resultLowFine));
-  np_tuneGoals->addLable(0.2,0.75, "Goaliness High: " + std::to_string(resultHighFine));
-  np_tuneGoals->addLable(0.2,0.80, "#chi^{2}/DoF 14+18: " + std::to_string(m_bestChiG_Training));
-  //np_tuneGoals->addLable(0.2,0.85, "#chi^{2}/DoF 2022: " + std::to_string(m_bestChiG_Test));
+  if (m_tuning.chi2G_Test >= 0) np_tuneGoals->addData(m_h_GoalsData_Test, "Data " + std::to_string(m_year), 0, false);
+  np_tuneGoals->addLable(0.2,0.70, "Goaliness Low: " + std::to_string(m_tuning.low));
+  np_tuneGoals->addLable(0.2,0.75, "Goaliness High: " + std::to_string(m_tuning.high));
+  np_tuneGoals->addLable(0.2,0.80, "#chi^{2}/DoF " + m_config.trainingLabel() + ": " + std::to_string(m_tuning.chi2G_Training));
+  if (m_tuning.chi2G_Test >= 0) np_tuneGoals->addLable(0.2,0.85, "#chi^{2}/DoF " + std::to_string(m_year) + ": " + std::to_string(m_tuning.chi2G_Test));
   nicePlot* np_tuneGoalDiff = new nicePlot(np_base_1d);
   np_tuneGoalDiff->init("Goal Difference", "Probability", "MC/Data");
-  np_tuneGoalDiff->addData(m_h_GoalDiffData_Training, "Data 14+18", 0, false);
+  np_tuneGoalDiff->addData(m_h_GoalDiffData_Training, "Data " + m_config.trainingLabel(), 0, false);
   np_tuneGoalDiff->addMC(m_h_GoalDiffMC, "MC", true, 0);
-  //np_tuneGoalDiff->addData(m_h_GoalDiffData_Test, "Data 2022", 0, false);
-  np_tuneGoalDiff->addLable(0.2,0.70, "Goaliness Low: " + std::to_string(resultLowFine));
-  np_tuneGoalDiff->addLable(0.2,0.75, "Goaliness High: " + std::to_string(resultHighFine));
-  np_tuneGoalDiff->addLable(0.2,0.80, "#chi^{2}/DoF 14+18: " + std::to_string(m_bestChiGD_Training));
-  //np_tuneGoalDiff->addLable(0.2,0.85, "#chi^{2}/DoF 2022: " + std::to_string(m_bestChiGD_Test));
+  if (m_tuning.chi2GD_Test >= 0) np_tuneGoalDiff->addData(m_h_GoalDiffData_Test, "Data " + std::to_string(m_year), 0, false);
+  np_tuneGoalDiff->addLable(0.2,0.70, "Goaliness Low: " + std::to_string(m_tuning.low));
+  np_tuneGoalDiff->addLable(0.2,0.75, "Goaliness High: " + std::to_string(m_tuning.high));
+  np_tuneGoalDiff->addLable(0.2,0.80, "#chi^{2}/DoF " + m_config.trainingLabel() + ": " + std::to_string(m_tuning.chi2GD_Training));
+  if (m_tuning.chi2GD_Test >= 0) np_tuneGoalDiff->addLable(0.2,0.85, "#chi^{2}/DoF " + std::to_string(m_year) + ": " + std::to_string(m_tuning.chi2GD_Test));
   bookOutput::setBreak(1);
   bookOutput::get().doMultipadOutput("WCMC_Tuning", 2, 1);
   bookOutput::clear();
@@ -817,7 +661,8 @@ void WCMC::execute() {
     np_base_1d->setLineWidth(2);
     np_base_1d->setLegend(.7, .75);
     np_base_1d->setBounds(-.5, 3.5, 0, 1.4);
-    for (const std::string& group : group_letters) {
+    for (int g = 0; g < m_config.nGroups(); ++g) {
+      const std::string& group = m_config.groupLetter(g);
       nicePlot* np = new nicePlot(np_base_1d);
       np->init("Team", "Probability");
       np->normaliseToOne();
@@ -825,17 +670,17 @@ void WCMC::execute() {
       np->addStackMC(m_h_roundWinner[group+"2"], "3rd");
       np->addStackMC(m_h_roundWinner[group+"1"], "Runner Up");
       np->addStackMC(m_h_roundWinner[group+"0"], "Winner");
-      const std::vector<std::string>& teams = m_groups.at(group);
-      for (const std::string& team : teams) np->addBinLabel(team);
+      const std::vector<int>& teams = m_config.group(g);
+      for (const int team : teams) np->addBinLabel(m_config.team(team).name);
       np->addLable(.25, .85, "Group " + group);
-      np->addLable(.25, .80, "Winner: " + teams.at( m_h_roundWinner[group+"0"]->GetMaximumBin()-1 ) );
-      np->addLable(.25, .75, "Runner Up: " + teams.at( m_h_roundWinner[group+"1"]->GetMaximumBin()-1 ) );
+      np->addLable(.25, .80, "Winner: " + m_config.team(teams.at( m_h_roundWinner[group+"0"]->GetMaximumBin()-1 )).name );
+      np->addLable(.25, .75, "Runner Up: " + m_config.team(teams.at( m_h_roundWinner[group+"1"]->GetMaximumBin()-1 )).name );
     }
     bookOutput::get().doMultipadOutput("WCMC_GroupResults", 2, 4);
     bookOutput::clear();
   }
 
-  np_base_1d->setBounds(0, m_teams.size());
+  np_base_1d->setBounds(0, m_config.nTeams());
   np_base_1d->setDoLegend(false);
   double labelOffset = .3;
   if (m_mode < kAFTER_16) {
@@ -845,7 +690,7 @@ void WCMC::execute() {
   np_base_1d->useAltColourScheme(1);
   np_base_1d->setLineWidth(6);
 
-  for (const std::string& team : m_teamsByRank) np_base_1d->addBinLabel(m_teams[team].m_abreviation);
+  for (int t = 0; t < m_config.nTeams(); ++t) np_base_1d->addBinLabel(m_config.team(t).abbreviation);
 
   for (int i = (int)m_mode; i < 5; ++i) {
     nicePlot* np_round = new nicePlot(np_base_1d);
@@ -884,19 +729,200 @@ void WCMC::execute() {
     bookOutput::setBreak(1);
     bookOutput::get().doBookOutput("WCMC_Goals");
   }
+  delete np_base; // Templates are never booked, the plots copied from them were released with their books
+  delete np_base_1d;
 }
 
-int main() {
-  gROOT->ProcessLine(".L AtlasStyle.C");
-  gROOT->ProcessLine("SetAtlasStyle();");
+void printUsage() {
+  std::cout << "Usage: wcMC.exe [--mode 0-4] [--year 2022] [--trials N] [--threads N] [--headless] [--results results.csv] [--store trials.wcs] [--load-store trials.wcs] [--query \"Brazil@F & Argentina@F\"]" << std::endl;
+  std::cout << "       wcMC.exe [--formats book,png,pdf,root] [--plot-workers N] [--replot] [--root-file out.root | --no-root-file] [--report report.html] [--log-level info]" << std::endl;
+  std::cout << "       wcMC.exe [--snapshot progress.json] [--snapshot-interval 5]" << std::endl;
+  std::cout << "       wcMC.exe [--historic results.csv] [--historic-from YYYY-MM-DD] [--historic-to YYYY-MM-DD] [--historic-competition name] [--historic-team name]" << std::endl;
+  std::cout << "       wcMC.exe --backtest [--trials N] [--baseline backtest_summary.txt]" << std::endl;
+  std::cout << "       wcMC.exe [--mode 0-4] [--trials N] --shard i/K [--partial file]  then  wcMC.exe [--mode 0-4] --merge files..." << std::endl;
+}
+
+// The whole of text as an integer in [min, max]
+bool parseInteger(const std::string& text, const long long min, const long long max, long long& value) {
+  char* end = nullptr;
+  errno = 0;
+  value = std::strtoll(text.c_str(), &end, 10);
+  return !text.empty() && *end == '\0' && errno == 0 && value >= min && value <= max;
+}
+
+bool parseOptions(int argc, char* argv[], Mode& mode, RunOptions& options, std::string& loadStore, bool& backtest) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool hasValue = (i + 1 < argc);
+    long long number = 0;
+    if ((arg == "--mode" || arg == "--year" || arg == "--trials" || arg == "--threads" || arg == "--plot-workers") && hasValue) {
+      const std::string value = argv[++i];
+      const bool isMode = (arg == "--mode");
+      const long long min = (arg == "--year" || arg == "--trials") ? 1 : 0; // Thread and worker counts take 0 for one per core
+      const long long max = isMode ? (long long)kAFTER_SEMI : (arg == "--trials" ? LLONG_MAX : INT_MAX);
+      if (!parseInteger(value, min, max, number)) {
+        std::cout << "Error. Invalid " << arg << " " << value << std::endl;
+        printUsage();
+        return false;
+      }
+      if      (isMode) mode = (Mode) number;
+      else if (arg == "--year") options.year = number;
+      else if (arg == "--trials") options.trials = number;
+      else if (arg == "--threads") options.threads = number;
+      else options.plotWorkers = number;
+    }
+    else if (arg == "--store" && hasValue) options.trialStore = argv[++i];
+    else if (arg == "--query" && hasValue) options.queries.push_back(argv[++i]);
+    else if (arg == "--load-store" && hasValue) loadStore = argv[++i];
+    else if (arg == "--baseline" && hasValue) options.baseline = argv[++i];
+    else if (arg == "--backtest") backtest = true;
+    else if (arg == "--headless") options.headless = true;
+    else if (arg == "--results" && hasValue) options.results = argv[++i];
+    else if (arg == "--replot") options.replot = true;
+    else if (arg == "--report" && hasValue) options.report = argv[++i];
+    else if (arg == "--snapshot" && hasValue) options.snapshot = argv[++i];
+    else if (arg == "--snapshot-interval" && hasValue) {
+      char* end = nullptr;
+      options.snapshotInterval = std::strtod(argv[++i], &end);
+      if (end == argv[i] || *end != '\0' || !(options.snapshotInterval > 0)) { std::cout << "Error. Invalid --snapshot-interval " << argv[i] << std::endl; printUsage(); return false; }
+    }
+    else if (arg == "--historic" && hasValue) options.historic = argv[++i];
+    else if (arg == "--historic-competition" && hasValue) options.historicSelection.competitions.push_back(argv[++i]);
+    else if (arg == "--historic-team" && hasValue) options.historicSelection.teams.push_back(argv[++i]);
+    else if ((arg == "--historic-from" || arg == "--historic-to") && hasValue) {
+      const uint32_t date = historicMatches::parseDate(argv[++i]);
+      if (date == 0) { std::cout << "Error. Expected " << arg << " YYYY-MM-DD" << std::endl; return false; }
+      (arg == "--historic-from" ? options.historicSelection.from : options.historicSelection.to) = date;
+    }
+    else if (arg == "--log-level" && hasValue) {
+      logLevel_t level;
+      if (!logger::parseLevel(argv[++i], level)) { std::cout << "Error. Expected --log-level error|warning|info|debug" << std::endl; return false; }
+      logger::get().setLevel(level);
+    }
+    else if (arg == "--root-file" && hasValue) options.rootFile = argv[++i];
+    else if (arg == "--no-root-file") options.rootOutput = false;
+    else if (arg == "--formats" && hasValue) {
+      std::istringstream formats(argv[++i]);
+      std::string format;
+      options.plotFormats = 0;
+      while ( getline(formats, format, ',') ) {
+        if      (format == "book") options.plotFormats |= kBookPDF;
+        else if (format == "png")  options.plotFormats |= kPagePNG;
+        else if (format == "pdf")  options.plotFormats |= kPagePDF;
+        else if (format == "root") options.plotFormats |= kPageROOT;
+        else { std::cout << "Error. Unknown plot format " << format << ", expected book,png,pdf,root" << std::endl; return false; }
+      }
+    }
+    else if (arg == "--shard" && hasValue) {
+      const std::string shard = argv[++i];
+      const size_t slash = shard.find('/');
+      long long index = 0, count = 0;
+      if (slash == std::string::npos || !parseInteger(shard.substr(0, slash), 0, INT_MAX, index) || !parseInteger(shard.substr(slash + 1), 1, INT_MAX, count) || index >= count) {
+        std::cout << "Error. Expected --shard index/count, got " << shard << std::endl;
+        printUsage();
+        return false;
+      }
+      options.shard = index;
+      options.shards = count;
+    }
+    else if (arg == "--partial" && hasValue) options.partial = argv[++i];
+    else if (arg == "--merge") {
+      while (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0) options.merge.push_back(argv[++i]);
+    }
+    else {
+      std::cout << "Unknown option " << arg << std::endl;
+      printUsage();
+      return false;
+    }
+  }
+  return true;
+}
+
+// Forecast every tournament we have groups and ranks for, one process per year, and score against the results
+int runBacktest(RunOptions options) {
+  std::vector<int> years;
+  for (int year = 1930; year < 2100; year += 4) {
+    if (std::ifstream("wc_" + std::to_string(year) + "_groups.txt") && std::ifstream("wc_" + std::to_string(year) + "_team_ranks.txt")) years.push_back(year);
+  }
+  options.plots = false;
+  options.rootOutput = false; // WCMC_<year>_Mode0.root would overwrite a normal run's
+  options.trialStore.clear();
+  std::cout << "Backtesting " << years.size() << " tournaments with " << options.trials << " trials each" << std::endl;
+  std::map<int, pid_t> children;
+  for (const int year : years) {
+    std::cout << std::flush;
+    const pid_t pid = fork();
+    if (pid < 0) {
+      std::cout << "Error. Cannot fork for " << year << std::endl;
+      continue;
+    } else if (pid == 0) {
+      const std::string name = "backtest_" + std::to_string(year);
+      if (freopen((name + ".log").c_str(), "w", stdout) == nullptr) _exit(1);
+      options.year = year;
+      WCMC wc(kFULL_TOURNAMENT, options);
+      if (!wc.load()) _exit(1);
+      wc.execute();
+      const bool ok = wc.m_scorer.write(name + ".txt", year, wc.m_tuning.chi2G_Test, wc.m_tuning.chi2GD_Test);
+      PROFILE_SUMMARY();
+      logger::get().flush(); // _exit skips the logger's destructor
+      std::cout << std::flush;
+      _exit(ok ? 0 : 1);
+    }
+    children[year] = pid;
+  }
+
+  bool ok = true;
+  std::ofstream summary("backtest_summary.txt");
+  for (const auto& [year, pid] : children) {
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      std::cout << "Error. Backtest of " << year << " failed, see backtest_" << year << ".log" << std::endl;
+      ok = false;
+      continue;
+    }
+    std::ifstream scores("backtest_" + std::to_string(year) + ".txt");
+    summary << scores.rdbuf();
+  }
+  summary.close();
+  printBacktest("backtest_summary.txt");
+  if (!options.baseline.empty() && !compareToBaseline("backtest_summary.txt", options.baseline)) ok = false;
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+  Mode mode = kAFTER_SEMI;
+  RunOptions options;
+  std::string loadStore;
+  bool backtest = false;
+  if (!parseOptions(argc, argv, mode, options, loadStore, backtest)) return 1;
+  if (options.headless) {
+    options.plots = false;
+    if (options.results.empty()) options.results = "WCMC_results.csv";
+  }
+  if (!loadStore.empty()) { // Post-hoc analysis, no simulation
+    queryTrialStore(loadStore, options.queries);
+    return 0;
+  }
+  if (backtest) {
+    gErrorIgnoreLevel = 10000;
+    return runBacktest(options);
+  }
+  bookOutput::setFormats(options.plotFormats);
+  bookOutput::setWorkers(options.plotWorkers);
+  bookOutput::setIncremental(!options.replot);
+  if (options.headless || options.plotWorkers != 1) { // Page export workers are forked, which needs batch mode
+    gROOT->SetBatch(true);
+  }
+  if (options.plots) SetAtlasStyle(); // Compiled in, nothing to interpret at startup
   gErrorIgnoreLevel = 10000;
-  //WCMC wc2022_a(kFULL_TOURNAMENT);
-  //WCMC wc2018_b(kAFTER_GROUP);
-  //WCMC wc2018_c(kAFTER_16);
-  //WCMC wc2018_d(kAFTER_QUARTER);
-  WCMC wc2018_e(kAFTER_SEMI);
+  WCMC wc(mode, options);
+  if (!wc.load()) return 1;
+  wc.execute();
+  PROFILE_SUMMARY();
+  return 0;
 }
 
 int wcMC() {
-  return main();
-}
\ No newline at end of file
+  return main(0, nullptr);
+}
@@ -0,0 +1,185 @@
+#include "wcResults.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include "htmlReport.h"
+#include "profile.h"
+
+namespace {
+  // Score matrices of the fixtures played, by "<teamA>_<teamB>" as the histograms of the plots and files
+  std::map<std::string, const binCounts*> fixtures(const tournamentConfig& config, const simulationResults& results) {
+    std::map<std::string, const binCounts*> scores;
+    for (int a = 0; a < config.nTeams(); ++a) {
+      for (int b = 0; b < config.nTeams(); ++b) {
+        if (results.played(a, b)) scores[config.team(a).name + "_" + config.team(b).name] = &results.scores[a * results.nTeams + b];
+      }
+    }
+    return scores;
+  }
+
+  double positionProbability(const simulationResults& results, const int group, const int position, const int teamInGroup) {
+    return results.groupPositions[group * kTeamsPerGroup + position].count(teamInGroup + 1) / (double) results.trials;
+  }
+
+  // Every outcome, most common first. Runs of more than 20 equally common outcomes are summarised
+  void printMostCommon(std::map<std::string, uint64_t>& outcomes, const std::string& label) {
+    int iterations = 0;
+    int print = 0;
+    while (outcomes.size()) {
+      // Find
+      uint64_t highestScore = 0;
+      for (auto const& [key, val] : outcomes) {
+        if (val > highestScore) {
+          highestScore = val;
+        }
+      }
+      // Extract
+      std::vector<std::string> outcomesWithScore;
+      for (auto const& [key, val] : outcomes) {
+        if (val == highestScore) {
+          outcomesWithScore.push_back(key);
+        }
+      }
+      // Erase & report
+      bool doPrint = outcomesWithScore.size() <= 20 && ++print < 20;
+      if (!doPrint && outcomesWithScore.size() > 1) std::cout << "Most common outcome" << label << " #" << ++iterations << ": with " << highestScore << " instances has " << outcomesWithScore.size() << " members" << std::endl;
+      for (const std::string& s : outcomesWithScore) {
+        outcomes.erase(s);
+        if (doPrint) std::cout << "Most common outcome" << label << " #" << ++iterations << ": with " << highestScore << " instances = " << s << std::endl;
+      }
+    }
+  }
+}
+
+void printOutcomes(simulationResults& results, const Mode mode) {
+  PROFILE_MAX("Outcomes (to semi) map size", results.outcomesToSemi.size());
+  PROFILE_MAX("Outcomes (to quarter) map size", results.outcomesToQuarter.size());
+  PROFILE_MAX("Outcomes map size", results.outcomes.size());
+
+  if (results.outcomesToSemi.empty()) return; // Outcomes went to the trial store
+
+  PROFILE_SCOPE("Top-K reporting");
+  if (mode == kAFTER_QUARTER) return;
+  std::cout << "Outcomes to semi size is " << results.outcomesToSemi.size() << std::endl;
+  printMostCommon(results.outcomesToSemi, " (to semi)");
+
+  if (mode == kAFTER_16) return;
+  std::cout << "Outcomes to quarter size is " << results.outcomesToQuarter.size() << std::endl;
+  printMostCommon(results.outcomesToQuarter, " (to quarter)");
+
+  if (mode == kAFTER_GROUP) return;
+  std::cout << "Outcomes size is " << results.outcomes.size() << std::endl;
+  printMostCommon(results.outcomes, "");
+}
+
+void scoreForecast(const tournamentConfig& config, const simulationResults& results, forecastScorer& scorer) {
+  const std::string passFiles[5] = {"pass_groups", "pass_16", "pass_quarter", "pass_semi", "pass_final"};
+  const unsigned passing[5] = {16, 8, 4, 2, 1}; // pass_semi also lists the losing semi finalists
+  for (int i = (int)config.mode(); i < 5; ++i) {
+    std::ifstream pass(config.dataFile(passFiles[i]));
+    if (!pass) continue; // Not played yet
+    std::vector<std::string> passed;
+    std::string line;
+    while ( getline(pass, line) && passed.size() < passing[i] ) {
+      std::vector<std::string> fields = tournamentConfig::readLine(line);
+      if (fields.size()) passed.push_back(fields[0]);
+    }
+    for (int t = 0; t < config.nTeams(); ++t) {
+      const std::string& team = config.team(t).name;
+      scorer.add(kStagePassed[i], results.stageProbability(t, i), std::count(passed.begin(), passed.end(), team) != 0);
+    }
+  }
+}
+
+bool writeResults(const std::string& fname, const tournamentConfig& config, const simulationResults& results, const tuningResult& tuning) {
+  std::ofstream out(fname);
+  if (!out) {
+    std::cout << "Error. Cannot write results to " << fname << std::endl;
+    return false;
+  }
+  const Mode mode = config.mode();
+  out << std::setprecision(6);
+  out << "tuning," << config.year() << "," << (int)mode << "," << results.trials << "," << tuning.low << "," << tuning.high << ","
+    << tuning.chi2G_Training << "," << tuning.chi2GD_Training << "," << tuning.chi2G_Test << "," << tuning.chi2GD_Test << std::endl;
+  for (int i = (int)mode; i < 5; ++i) {
+    for (int t = 0; t < config.nTeams(); ++t) {
+      out << "stage," << config.team(t).name << "," << config.team(t).abbreviation << "," << kStagePassed[i] << "," << results.stageProbability(t, i) << std::endl;
+    }
+  }
+  if (mode == kFULL_TOURNAMENT) {
+    for (int g = 0; g < config.nGroups(); ++g) {
+      const std::vector<int>& teams = config.group(g);
+      for (unsigned position = 0; position < teams.size(); ++position) {
+        for (unsigned t = 0; t < teams.size(); ++t) {
+          out << "position," << config.groupLetter(g) << "," << config.team(teams.at(t)).name << "," << position + 1 << "," << positionProbability(results, g, position, t) << std::endl;
+        }
+      }
+    }
+  }
+  for (const auto& [key, h] : fixtures(config, results)) {
+    const std::string teamA = key.substr(0, key.find('_')), teamB = key.substr(key.find('_') + 1);
+    const double total = h->total(); // Including the overflow
+    if (total <= 0) continue;
+    for (int a = 0; a < h->nx(); ++a) {
+      for (int b = 0; b < h->ny(); ++b) {
+        const double n = h->count(h->cell(a + 1, b + 1));
+        if (n > 0) out << "score," << teamA << "," << teamB << "," << a << "," << b << "," << n / total << std::endl;
+      }
+    }
+    const int modal = h->maximumCell();
+    out << "modal," << teamA << "," << teamB << "," << modal % (h->nx() + 2) - 1 << "," << modal / (h->nx() + 2) - 1 << "," << h->count(modal) / total << std::endl;
+  }
+  std::cout << "Wrote results to " << fname << std::endl;
+  return true;
+}
+
+bool writeReport(const std::string& fname, const tournamentConfig& config, const simulationResults& results) {
+  const Mode mode = config.mode();
+  htmlReport report("WCMC " + std::to_string(config.year()) + ", " + std::to_string(results.trials) + " trials from " +
+    (mode == kFULL_TOURNAMENT ? std::string("the start") : "after the " + kStagePassed[(int)mode - 1]));
+  std::vector<std::string> abbreviations;
+  for (int t = 0; t < config.nTeams(); ++t) abbreviations.push_back(config.team(t).abbreviation);
+
+  report.section("Reaching each stage");
+  for (int i = (int)mode; i < 5; ++i) {
+    std::vector<double> p;
+    for (int t = 0; t < config.nTeams(); ++t) p.push_back(results.stageProbability(t, i));
+    report.bars("Passed " + kStagePassed[i], abbreviations, p);
+  }
+
+  if (mode == kFULL_TOURNAMENT) {
+    report.section("Group positions");
+    for (int g = 0; g < config.nGroups(); ++g) {
+      const std::vector<int>& teams = config.group(g);
+      std::vector<std::string> positions, rows;
+      std::vector<double> p(teams.size() * teams.size());
+      for (unsigned position = 0; position < teams.size(); ++position) {
+        positions.push_back(std::to_string(position + 1));
+        for (unsigned t = 0; t < teams.size(); ++t) p.at(t * teams.size() + position) = positionProbability(results, g, position, t);
+      }
+      for (const int team : teams) rows.push_back(config.team(team).abbreviation);
+      report.heatmap("Group " + config.groupLetter(g), "Position", "", positions, rows, p, true);
+    }
+  }
+
+  report.section("Score matrices");
+  std::vector<std::string> goals;
+  for (int g = 0; g < 8; ++g) goals.push_back(std::to_string(g));
+  for (const auto& [key, h] : fixtures(config, results)) {
+    const std::string teamA = key.substr(0, key.find('_')), teamB = key.substr(key.find('_') + 1);
+    const double total = h->total(); // Including the overflow
+    if (total <= 0) continue;
+    std::vector<double> p;
+    for (int b = 0; b < h->ny(); ++b) {
+      for (int a = 0; a < h->nx(); ++a) p.push_back(h->count(h->cell(a + 1, b + 1)) / total);
+    }
+    const std::string abA = config.team(config.teamIndex(teamA)).abbreviation, abB = config.team(config.teamIndex(teamB)).abbreviation;
+    report.heatmap(teamA + " v " + teamB, abA + " goals", abB, goals, goals, p, false);
+  }
+
+  if (!report.write(fname)) return false;
+  std::cout << "Wrote report to " << fname << std::endl;
+  return true;
+}
@@ -0,0 +1,28 @@
+#ifndef WCMC_WCRESULTS_H
+#define WCMC_WCRESULTS_H
+
+#include <string>
+#include "backtest.h"
+#include "wcEngine.h"
+
+// What a client does with the simulationResults of a run, without ROOT: print, score and write them.
+// Probabilities are counts over results.trials, score matrices are normalised to every trial of their fixture.
+
+// Most common tournament outcomes of the Mode, consuming the outcome counts. Nothing if they went to a trial store
+void printOutcomes(simulationResults& results, const Mode mode);
+
+// Stage probabilities of the teams against the wc_<year>_pass_*.txt files that exist
+void scoreForecast(const tournamentConfig& config, const simulationResults& results, forecastScorer& scorer);
+
+// One record per line, the first field says which:
+//   tuning,year,mode,trials,goalinessLow,goalinessHigh,chi2G_Training,chi2GD_Training,chi2G_Test,chi2GD_Test (-1 if not available)
+//   stage,team,abbreviation,stagePassed,probability
+//   position,group,team,position,probability
+//   score,teamA,teamB,goalsA,goalsB,probability (non-zero cells up to 7 goals each)
+//   modal,teamA,teamB,goalsA,goalsB,probability
+bool writeResults(const std::string& fname, const tournamentConfig& config, const simulationResults& results, const tuningResult& tuning);
+
+// Stage progression, group positions and every score matrix as inline SVG, from the same numbers as writeResults
+bool writeReport(const std::string& fname, const tournamentConfig& config, const simulationResults& results);
+
+#endif // WCMC_WCRESULTS_H